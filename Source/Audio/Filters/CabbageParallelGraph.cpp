@@ -0,0 +1,549 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#include "CabbageParallelGraph.h"
+
+//==============================================================================
+// Everything the audio thread and the workers share for one version of the
+// graph. It is built on the message thread and swapped in under the graph's
+// callback lock, so it never changes while a block is being rendered.
+//==============================================================================
+struct CabbageParallelGraph::Schedule
+{
+    struct Input
+    {
+        int sourceNode, sourceChannel, destChannel;
+    };
+
+    struct ScheduledNode
+    {
+        Node::Ptr node;
+        AudioProcessor* processor = nullptr;
+        int ioType = -1;
+        AudioBuffer<float> buffer;
+        MidiBuffer midi;
+        Array<Input> inputs;
+        Array<int> dependents;
+        int numDependencies = 0;
+        std::atomic<int> pendingDependencies { 0 };
+
+        std::atomic<int64> lastTicks { 0 }, peakTicks { 0 }, totalTicks { 0 };
+        std::atomic<int> lastThread { -1 };
+    };
+
+    //what each node's MIDI buffer is allocated with, events past it are dropped
+    enum { midiBufferBytes = 2048 };
+
+    OwnedArray<ScheduledNode> nodes;
+    int blockSize = 0;
+    bool canRenderInParallel = true;
+
+    //each node goes on the ready list exactly once per block, so a slot per node
+    //is all it needs. A slot holds its node's index + 1 once it has been queued.
+    std::unique_ptr<std::atomic<int>[]> readySlots;
+    std::atomic<int> numQueued { 0 }, numTaken { 0 }, numRendered { 0 };
+
+    //this block
+    const AudioBuffer<float>* inputBuffer = nullptr;
+    const MidiBuffer* midiInput = nullptr;
+    int numSamples = 0;
+
+    std::atomic<int64> numBlocks { 0 }, totalBlockTicks { 0 };
+
+    void startBlock()
+    {
+        numQueued = 0;
+        numTaken = 0;
+        numRendered = 0;
+
+        for (int i = 0; i < nodes.size(); ++i)
+        {
+            readySlots[i] = 0;
+            nodes.getUnchecked (i)->pendingDependencies = nodes.getUnchecked (i)->numDependencies;
+        }
+
+        for (int i = 0; i < nodes.size(); ++i)
+            if (nodes.getUnchecked (i)->numDependencies == 0)
+                pushReady (i);
+    }
+
+    void pushReady (int nodeIndex)
+    {
+        const int slot = numQueued.fetch_add (1);
+        readySlots[slot].store (nodeIndex + 1, std::memory_order_release);
+    }
+
+    //false if nothing is ready right now, which doesn't mean the block is done
+    bool popReady (int& nodeIndex)
+    {
+        int taken = numTaken.load();
+
+        while (taken < nodes.size())
+        {
+            const int value = readySlots[taken].load (std::memory_order_acquire);
+
+            if (value == 0)
+                return false;
+
+            if (numTaken.compare_exchange_weak (taken, taken + 1))
+            {
+                nodeIndex = value - 1;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    //MidiBuffer::addEvents() grows the buffer as it needs to. Node buffers are only
+    //allocated here, so whatever doesn't fit is dropped rather than allocate mid block
+    static void addEvents (MidiBuffer& dest, const MidiBuffer& source, int numSamples)
+    {
+        MidiBuffer::Iterator i (source);
+        const uint8* data;
+        int numBytes, samplePosition;
+
+        while (i.getNextEvent (data, numBytes, samplePosition) && samplePosition < numSamples)
+        {
+            if (dest.data.size() + numBytes + (int) (sizeof (int32) + sizeof (uint16)) > midiBufferBytes)
+                break;
+
+            if (samplePosition >= 0)
+                dest.addEvent (data, numBytes, samplePosition);
+        }
+    }
+};
+
+//==============================================================================
+class CabbageParallelGraph::Worker  : public Thread
+{
+public:
+    Worker (CabbageParallelGraph& g, int index)
+        : Thread ("Graph worker " + String (index)), graph (g), threadIndex (index)
+    {}
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            graph.runWorker (threadIndex);
+            //woken by processBlock() at the start of each block
+            wait (100);
+        }
+    }
+
+private:
+    CabbageParallelGraph& graph;
+    const int threadIndex;
+};
+
+class CabbageParallelGraph::ScheduleRebuilder  : public juce::AsyncUpdater
+{
+public:
+    ScheduleRebuilder (CabbageParallelGraph& g) : graph (g) {}
+    void handleAsyncUpdate() override   { graph.rebuildSchedule(); }
+
+private:
+    CabbageParallelGraph& graph;
+};
+
+//==============================================================================
+CabbageParallelGraph::CabbageParallelGraph()
+    : scheduleRebuilder (new ScheduleRebuilder (*this))
+{
+    setNumWorkerThreads (jlimit (0, 7, SystemStats::getNumCpus() - 1));
+    addChangeListener (this);
+}
+
+CabbageParallelGraph::~CabbageParallelGraph()
+{
+    removeChangeListener (this);
+    scheduleRebuilder->cancelPendingUpdate();
+    setNumWorkerThreads (0);
+    schedule.reset();
+}
+
+void CabbageParallelGraph::setNumWorkerThreads (int numWorkers)
+{
+    const ScopedLock sl (getCallbackLock());
+
+    //workers only run while processBlock() is inside a block, which the lock rules out
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto* worker : workers)
+        worker->stopThread (1000);
+
+    workers.clear();
+
+    //the audio thread waits on any node a worker has taken, so they run at its priority
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        auto* worker = workers.add (new Worker (*this, i + 1));
+        worker->startThread (Thread::realtimeAudioPriority);
+    }
+}
+
+//==============================================================================
+void CabbageParallelGraph::prepareToPlay (double sampleRate, int estimatedSamplesPerBlock)
+{
+    AudioProcessorGraph::prepareToPlay (sampleRate, estimatedSamplesPerBlock);
+    isGraphPrepared = true;
+
+    //the graph prepares its nodes asynchronously when called off the message thread,
+    //the rebuild is queued behind it so the schedule never holds an unprepared node.
+    //Until then there is no schedule, and the graph's own checks decide what is played
+    if (MessageManager::getInstance()->isThisTheMessageThread())
+    {
+        rebuildSchedule();
+    }
+    else
+    {
+        std::unique_ptr<Schedule> oldSchedule;
+
+        {
+            const ScopedLock sl (getCallbackLock());
+            std::swap (schedule, oldSchedule);
+        }
+
+        scheduleRebuilder->triggerAsyncUpdate();
+    }
+}
+
+void CabbageParallelGraph::releaseResources()
+{
+    std::unique_ptr<Schedule> oldSchedule;
+
+    {
+        const ScopedLock sl (getCallbackLock());
+        isGraphPrepared = false;
+        std::swap (schedule, oldSchedule);
+    }
+
+    AudioProcessorGraph::releaseResources();
+}
+
+void CabbageParallelGraph::changeListenerCallback (ChangeBroadcaster*)
+{
+    //topology changes are broadcast before the graph queues its own rebuild,
+    //so going through another async update puts ours after it
+    scheduleRebuilder->triggerAsyncUpdate();
+}
+
+void CabbageParallelGraph::rebuildSchedule()
+{
+    std::unique_ptr<Schedule> newSchedule (isGraphPrepared ? createSchedule() : nullptr);
+
+    const ScopedLock sl (getCallbackLock());
+    std::swap (schedule, newSchedule);
+}
+
+//==============================================================================
+CabbageParallelGraph::Schedule* CabbageParallelGraph::createSchedule()
+{
+    std::unique_ptr<Schedule> newSchedule (new Schedule());
+    Schedule& s = *newSchedule;
+    s.blockSize = getBlockSize();
+
+    HashMap<uint32, int> indexForNode;
+
+    for (auto* node : getNodes())
+    {
+        auto* scheduled = s.nodes.add (new Schedule::ScheduledNode());
+        scheduled->node = node;
+        scheduled->processor = node->getProcessor();
+        int numChannels = jmax (scheduled->processor->getTotalNumInputChannels(), scheduled->processor->getTotalNumOutputChannels());
+
+        if (auto* io = dynamic_cast<AudioGraphIOProcessor*> (scheduled->processor))
+        {
+            scheduled->ioType = io->getType();
+
+            if (scheduled->ioType == AudioGraphIOProcessor::audioInputNode)
+                numChannels = getTotalNumInputChannels();
+            else if (scheduled->ioType == AudioGraphIOProcessor::audioOutputNode)
+                numChannels = getTotalNumOutputChannels();
+        }
+
+        scheduled->buffer.setSize (jmax (1, numChannels), jmax (1, s.blockSize));
+        scheduled->midi.ensureSize (Schedule::midiBufferBytes);
+        indexForNode.set (node->nodeID.uid, s.nodes.size() - 1);
+    }
+
+    for (auto& connection : getConnections())
+    {
+        if (! indexForNode.contains (connection.source.nodeID.uid) || ! indexForNode.contains (connection.destination.nodeID.uid))
+            continue;
+
+        const int sourceIndex = indexForNode[connection.source.nodeID.uid];
+        const int destIndex = indexForNode[connection.destination.nodeID.uid];
+        auto& source = *s.nodes.getUnchecked (sourceIndex);
+        auto& dest = *s.nodes.getUnchecked (destIndex);
+
+        if (! connection.source.isMIDI()
+             && (connection.source.channelIndex >= source.buffer.getNumChannels()
+                  || connection.destination.channelIndex >= dest.buffer.getNumChannels()))
+            continue;
+
+        dest.inputs.add ({ sourceIndex, connection.source.channelIndex, connection.destination.channelIndex });
+
+        if (source.dependents.addIfNotAlreadyThere (destIndex))
+            ++dest.numDependencies;
+    }
+
+    //walk the graph in dependency order. It can only be split up if it has no cycles
+    //and no node is fed by paths of different latency, since that needs delay lines.
+    Array<int> order, pending, totalLatency;
+
+    for (auto* node : s.nodes)
+    {
+        pending.add (node->numDependencies);
+        totalLatency.add (-1);
+    }
+
+    for (int i = 0; i < s.nodes.size(); ++i)
+        if (pending[i] == 0)
+            order.add (i);
+
+    for (int i = 0; i < order.size(); ++i)
+    {
+        auto& node = *s.nodes.getUnchecked (order[i]);
+        int inputLatency = -1;
+
+        for (auto& input : node.inputs)
+        {
+            const int sourceLatency = totalLatency[input.sourceNode];
+
+            if (inputLatency >= 0 && sourceLatency != inputLatency)
+                s.canRenderInParallel = false;
+
+            inputLatency = jmax (inputLatency, sourceLatency);
+        }
+
+        totalLatency.set (order[i], jmax (0, inputLatency) + (node.ioType < 0 ? node.processor->getLatencySamples() : 0));
+
+        for (int dependent : node.dependents)
+        {
+            pending.set (dependent, pending[dependent] - 1);
+
+            if (pending[dependent] == 0)
+                order.add (dependent);
+        }
+    }
+
+    if (order.size() != s.nodes.size())
+        s.canRenderInParallel = false;
+
+    s.readySlots.reset (new std::atomic<int>[(size_t) jmax (1, s.nodes.size())]());
+    return newSchedule.release();
+}
+
+//==============================================================================
+void CabbageParallelGraph::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
+{
+    renderingInParallel = renderBlockInParallel (buffer, midiMessages);
+
+    //the graph checks that it is prepared, and waits for it in a non-realtime render,
+    //so it is called without the callback lock held
+    if (! renderingInParallel)
+        AudioProcessorGraph::processBlock (buffer, midiMessages);
+}
+
+//a schedule only exists once the graph has prepared its nodes, see prepareToPlay()
+bool CabbageParallelGraph::renderBlockInParallel (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
+{
+    const ScopedLock sl (getCallbackLock());
+
+    Schedule* const s = schedule.get();
+    const int numSamples = buffer.getNumSamples();
+
+    if (s == nullptr || ! s->canRenderInParallel || workers.size() == 0 || numSamples > s->blockSize)
+        return false;
+
+    const int64 startTicks = Time::getHighResolutionTicks();
+
+    s->inputBuffer = &buffer;
+    s->midiInput = &midiMessages;
+    s->numSamples = numSamples;
+    s->startBlock();
+
+    currentBlock = s;
+
+    for (auto* worker : workers)
+        worker->notify();
+
+    renderNodes (*s, 0);
+
+    //no worker may still be looking at this block when the next one is set up
+    currentBlock = nullptr;
+
+    while (numActiveWorkers.load() != 0)
+    {}
+
+    //the graph's own input has been copied into the input nodes, so it can now be written over
+    buffer.clear();
+    midiMessages.clear();
+
+    for (auto* node : s->nodes)
+    {
+        if (node->ioType == AudioGraphIOProcessor::audioOutputNode)
+        {
+            for (int channel = jmin (buffer.getNumChannels(), node->buffer.getNumChannels()); --channel >= 0;)
+                buffer.addFrom (channel, 0, node->buffer, channel, 0, numSamples);
+        }
+        else if (node->ioType == AudioGraphIOProcessor::midiOutputNode)
+            midiMessages.addEvents (node->midi, 0, numSamples, 0);
+    }
+
+    s->totalBlockTicks += Time::getHighResolutionTicks() - startTicks;
+    ++s->numBlocks;
+    return true;
+}
+
+void CabbageParallelGraph::runWorker (int threadIndex)
+{
+    ++numActiveWorkers;
+
+    if (Schedule* s = currentBlock.load())
+        renderNodes (*s, threadIndex);
+
+    --numActiveWorkers;
+}
+
+void CabbageParallelGraph::renderNodes (Schedule& s, int threadIndex)
+{
+    const int numNodes = s.nodes.size();
+    int nodeIndex = 0;
+
+    while (s.numRendered.load (std::memory_order_acquire) < numNodes)
+    {
+        if (s.popReady (nodeIndex))
+            renderNode (s, nodeIndex, threadIndex);
+        else
+            Thread::yield();
+    }
+}
+
+//==============================================================================
+// Gathers a node's inputs from the buffers of the nodes feeding it, which have
+// all finished by the time it is taken off the ready list, runs it, and puts
+// any node that was only waiting on this one on the ready list.
+//==============================================================================
+void CabbageParallelGraph::renderNode (Schedule& s, int nodeIndex, int threadIndex)
+{
+    auto& node = *s.nodes.getUnchecked (nodeIndex);
+    const int64 startTicks = Time::getHighResolutionTicks();
+    const int numSamples = s.numSamples;
+
+    AudioBuffer<float> buffer (node.buffer.getArrayOfWritePointers(), node.buffer.getNumChannels(), numSamples);
+    node.midi.clear();
+
+    if (node.ioType == AudioGraphIOProcessor::audioInputNode)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            if (channel < s.inputBuffer->getNumChannels())
+                buffer.copyFrom (channel, 0, *s.inputBuffer, channel, 0, numSamples);
+            else
+                buffer.clear (channel, 0, numSamples);
+        }
+    }
+    else if (node.ioType == AudioGraphIOProcessor::midiInputNode)
+    {
+        Schedule::addEvents (node.midi, *s.midiInput, numSamples);
+    }
+    else
+    {
+        buffer.clear();
+
+        for (auto& input : node.inputs)
+        {
+            auto& source = *s.nodes.getUnchecked (input.sourceNode);
+
+            if (input.destChannel == midiChannelIndex)
+                Schedule::addEvents (node.midi, source.midi, numSamples);
+            else
+                buffer.addFrom (input.destChannel, 0, source.buffer, input.sourceChannel, 0, numSamples);
+        }
+
+        if (node.ioType < 0)
+        {
+            AudioProcessor& processor = *node.processor;
+            const ScopedLock lock (processor.getCallbackLock());
+
+            if (processor.isSuspended())
+                buffer.clear();
+            else if (node.node->isBypassed())
+                processor.processBlockBypassed (buffer, node.midi);
+            else
+                processor.processBlock (buffer, node.midi);
+        }
+    }
+
+    const int64 ticks = Time::getHighResolutionTicks() - startTicks;
+    node.lastTicks = ticks;
+    node.totalTicks += ticks;
+    node.lastThread = threadIndex;
+
+    if (ticks > node.peakTicks)
+        node.peakTicks = ticks;
+
+    for (int dependent : node.dependents)
+        if (s.nodes.getUnchecked (dependent)->pendingDependencies.fetch_sub (1) == 1)
+            s.pushReady (dependent);
+
+    s.numRendered.fetch_add (1, std::memory_order_release);
+}
+
+//==============================================================================
+// releaseResources() can free the schedule from the audio device's thread when
+// it stops, so it is only read with the callback lock held. That holds up at
+// most one block, for the time it takes to copy a few numbers out.
+//==============================================================================
+CabbageParallelGraph::NodeTiming CabbageParallelGraph::getNodeTiming (NodeID nodeID) const
+{
+    const ScopedLock sl (getCallbackLock());
+    NodeTiming timing;
+
+    if (schedule == nullptr || schedule->numBlocks == 0)
+        return timing;
+
+    for (auto* node : schedule->nodes)
+    {
+        if (node->node->nodeID == nodeID)
+        {
+            timing.lastMs = Time::highResolutionTicksToSeconds (node->lastTicks) * 1000.0;
+            timing.peakMs = Time::highResolutionTicksToSeconds (node->peakTicks) * 1000.0;
+            timing.averageMs = Time::highResolutionTicksToSeconds (node->totalTicks) * 1000.0 / double (schedule->numBlocks);
+            timing.lastThread = node->lastThread;
+            break;
+        }
+    }
+
+    return timing;
+}
+
+double CabbageParallelGraph::getAverageBlockMs() const
+{
+    const ScopedLock sl (getCallbackLock());
+
+    if (schedule == nullptr || schedule->numBlocks == 0)
+        return 0;
+
+    return Time::highResolutionTicksToSeconds (schedule->totalBlockTicks) * 1000.0 / double (schedule->numBlocks);
+}
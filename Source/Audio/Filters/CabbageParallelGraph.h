@@ -0,0 +1,91 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// An AudioProcessorGraph that renders nodes which don't depend on each other
+// at the same time. Each block the audio thread and a pool of worker threads
+// take nodes off a shared ready list as soon as everything feeding them has
+// been rendered, so a graph of side by side instruments is spread over as
+// many cores as there are workers. The audio thread waits for the workers
+// to finish each block, so they run at realtime audio priority.
+//
+// The graph still prepares its nodes and keeps its own render sequence, which
+// is used whenever the parallel schedule can't be: double precision, blocks
+// larger than prepared for, no workers, or connections that would need
+// latency compensation.
+//==============================================================================
+class CabbageParallelGraph  : public AudioProcessorGraph,
+                              private ChangeListener
+{
+public:
+    CabbageParallelGraph();
+    ~CabbageParallelGraph();
+
+    //0 renders everything on the audio thread, through the graph's own sequence
+    void setNumWorkerThreads (int numWorkers);
+    int getNumWorkerThreads() const             { return workers.size(); }
+
+    struct NodeTiming
+    {
+        double averageMs = 0, lastMs = 0, peakMs = 0;
+        int lastThread = -1;
+    };
+
+    //timing of the last block, and an average over the blocks since the graph was last
+    //rebuilt. Both take the callback lock, so keep them off the audio thread
+    NodeTiming getNodeTiming (NodeID nodeID) const;
+    double getAverageBlockMs() const;
+    bool isRenderingInParallel() const          { return renderingInParallel; }
+
+    //==============================================================================
+    void prepareToPlay (double sampleRate, int estimatedSamplesPerBlock) override;
+    void releaseResources() override;
+    void processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages) override;
+    using AudioProcessorGraph::processBlock;
+
+private:
+    //==============================================================================
+    struct Schedule;
+    class Worker;
+    class ScheduleRebuilder;
+
+    void changeListenerCallback (ChangeBroadcaster*) override;
+    void rebuildSchedule();
+    Schedule* createSchedule();
+    bool renderBlockInParallel (AudioBuffer<float>& buffer, MidiBuffer& midiMessages);
+    void renderNodes (Schedule& schedule, int threadIndex);
+    void renderNode (Schedule& schedule, int nodeIndex, int threadIndex);
+    void runWorker (int threadIndex);
+
+    std::unique_ptr<Schedule> schedule;
+    OwnedArray<Worker> workers;
+    std::unique_ptr<ScheduleRebuilder> scheduleRebuilder;
+    bool isGraphPrepared = false;
+    std::atomic<bool> renderingInParallel { false };
+
+    //the audio thread hands each block to the workers through these
+    std::atomic<Schedule*> currentBlock { nullptr };
+    std::atomic<int> numActiveWorkers { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CabbageParallelGraph)
+};
@@ -39,6 +39,9 @@ FilterGraph::FilterGraph (AudioPluginFormatManager& fm)
                          "Save a filter graph"),
       formatManager (fm)
 {
+    // Csound's one-time global setup is not safe to race, so do it here
+    // before any instance can be created on the instantiation pool
+    csoundInitialize (0);
 
     newDocument();
     graph.addListener (this);
@@ -46,6 +49,9 @@ FilterGraph::FilterGraph (AudioPluginFormatManager& fm)
 
 FilterGraph::~FilterGraph()
 {
+    ++restoreGeneration;
+    instantiationPool.removeAllJobs (true, -1);
+    cancelPendingUpdate();
 	closeAnyOpenPluginWindows();
     graph.removeListener (this);
     graph.removeChangeListener (this);
@@ -132,6 +138,12 @@ Point<double> FilterGraph::getNodePosition (NodeID nodeID) const
 //==============================================================================
 void FilterGraph::clear()
 {
+    // instances still compiling from an earlier restore are discarded when they finish
+    ++restoreGeneration;
+    instantiationPool.removeAllJobs (false, 0);
+    numPendingCabbageNodes = 0;
+    pendingConnections = nullptr;
+
     closeAnyOpenPluginWindows();
     graph.clear();
     changed();
@@ -375,6 +387,86 @@ static XmlElement* createNodeXml(AudioProcessorGraph::Node* const node) noexcept
 	return nullptr;
 }
 
+//==============================================================================
+class FilterGraph::CabbageInstantiationJob : public ThreadPoolJob
+{
+public:
+    CabbageInstantiationJob (FilterGraph& g, PendingCabbageNode* n)
+        : ThreadPoolJob ("Cabbage instantiation"), owner (g), node (n)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        if (node->generation == owner.restoreGeneration.get())
+            node->processor = owner.createCabbageProcessor (node->desc.fileOrIdentifier);
+
+        owner.cabbageNodeReady (node.release());
+        return jobHasFinished;
+    }
+
+private:
+    FilterGraph& owner;
+    std::unique_ptr<PendingCabbageNode> node;
+};
+
+void FilterGraph::scheduleCabbageNode (const XmlElement& xml, const PluginDescription& desc)
+{
+    auto* node = new PendingCabbageNode();
+    node->xml.reset (new XmlElement (xml));
+    node->desc = desc;
+    node->generation = restoreGeneration.get();
+
+    ++numPendingCabbageNodes;
+    instantiationPool.addJob (new CabbageInstantiationJob (*this, node), true);
+}
+
+void FilterGraph::cabbageNodeReady (PendingCabbageNode* node)
+{
+    {
+        const ScopedLock sl (readyCabbageNodesLock);
+        readyCabbageNodes.add (node);
+    }
+
+    triggerAsyncUpdate();
+}
+
+void FilterGraph::handleAsyncUpdate()
+{
+    OwnedArray<PendingCabbageNode> ready;
+
+    {
+        const ScopedLock sl (readyCabbageNodesLock);
+        ready.swapWith (readyCabbageNodes);
+    }
+
+    for (auto* pending : ready)
+    {
+        if (pending->generation != restoreGeneration.get())
+            continue;
+
+        --numPendingCabbageNodes;
+
+        if (pending->processor == nullptr)
+            continue;
+
+        const Point<double> pos (pending->xml->getDoubleAttribute ("x"), pending->xml->getDoubleAttribute ("y"));
+        addCabbageNode (pending->desc, std::move (pending->processor), pos);
+
+        if (auto* node = graph.getNodeForId (NodeID (pending->desc.uid)))
+            if (auto w = getOrCreateWindowFor (node, PluginWindow::Type::normal))
+                w->toFront (true);
+
+        if (pendingConnections != nullptr)
+            restoreConnectionsFromXml (*pendingConnections);
+
+        changed();
+    }
+
+    if (numPendingCabbageNodes == 0)
+        pendingConnections = nullptr;
+}
+
 void FilterGraph::createNodeFromXml(const XmlElement& xml)
 {
 	PluginDescription pd;
@@ -473,10 +565,28 @@ void FilterGraph::restoreFromXml(const XmlElement& xml)
 
 	forEachXmlChildElementWithTagName(xml, e, "FILTER")
 	{
+		PluginDescription pd;
+
+		forEachXmlChildElement(*e, d)
+		{
+			if (pd.loadFromXml(*d))
+				break;
+		}
+
+		if (pd.pluginFormatName == "Cabbage")
+		{
+			scheduleCabbageNode(*e, pd);
+			continue;
+		}
+
 		createNodeFromXml(*e);
 		changed();
 	}
 
+	// keep the connections around until every Cabbage node has been compiled
+	if (numPendingCabbageNodes > 0)
+		pendingConnections.reset(new XmlElement(xml));
+
 	forEachXmlChildElementWithTagName(xml, e, "CONNECTION")
 	{
 		graph.addConnection({ { NodeID((uint32)e->getIntAttribute("srcFilter")), e->getIntAttribute("srcChannel") },
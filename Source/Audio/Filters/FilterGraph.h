@@ -30,6 +30,7 @@
 #include "../../Utilities/CabbageUtilities.h"
 #include "../Plugins/CabbagePluginProcessor.h"
 #include "../Plugins/GenericCabbagePluginProcessor.h"
+#include "CabbageParallelGraph.h"
 
 
 
@@ -39,7 +40,8 @@
 */
 class FilterGraph   : public FileBasedDocument,
                       public AudioProcessorListener,
-                      private ChangeListener
+                      private ChangeListener,
+                      private AsyncUpdater
 {
 
 public:
@@ -67,16 +69,13 @@ public:
 
 	static const String getInstrumentName(File csdFile)
 	{
-		StringArray csdLines;
-		csdLines.addLines(csdFile.loadFileAsString());
+		const String formLine = CsdDocument::load(csdFile)->getFormLine();
 
-		for (auto line : csdLines)
+		if (formLine.isNotEmpty())
 		{
 			ValueTree temp("temp");
-			CabbageWidgetData::setWidgetState(temp, line, 0);
-
-			if (CabbageWidgetData::getStringProp(temp, CabbageIdentifierIds::type) == CabbageWidgetTypes::form)
-				return CabbageWidgetData::getStringProp(temp, CabbageIdentifierIds::caption);
+			CabbageWidgetData::setWidgetState(temp, formLine, 0);
+			return CabbageWidgetData::getStringProp(temp, CabbageIdentifierIds::caption);
 		}
 
         return "";
@@ -214,8 +213,9 @@ public:
 	{
 		std::unique_ptr < AudioProcessor> processor;
         
-		const bool isCabbageFile = CabbageUtilities::hasCabbageTags(File(filename));
-		const int numChannels = CabbageUtilities::getHeaderInfo(File(filename).loadFileAsString(), "nchnls");
+		std::shared_ptr<const CsdDocument> csdDocument = CsdDocument::load(File(filename));
+		const bool isCabbageFile = csdDocument->hasCabbageSection();
+		const int numChannels = csdDocument->getNumChannels();
 
 		if (isCabbageFile)
 			processor = std::unique_ptr<CabbagePluginProcessor>(new CabbagePluginProcessor(File(filename), numChannels, numChannels));
@@ -232,9 +232,13 @@ public:
 
     //RW
 	void addCabbagePlugin(const PluginDescription& desc, Point<double> pos)
+	{
+		addCabbageNode(desc, createCabbageProcessor(desc.fileOrIdentifier), pos);
+	}
+
+	void addCabbageNode(const PluginDescription& desc, std::unique_ptr<AudioProcessor> processor, Point<double> pos)
 	{
 		AudioProcessorGraph::NodeID nodeId(desc.uid);
-		std::unique_ptr <AudioProcessor> processor = createCabbageProcessor(desc.fileOrIdentifier);
 		const bool isCabbageFile = CabbageUtilities::hasCabbageTags(File(desc.fileOrIdentifier));
 
 		if (auto* plugin = graph.getNodeForId(nodeId))
@@ -382,7 +386,8 @@ public:
     static File getDefaultGraphDocumentOnMobile();
 
     //==============================================================================
-    AudioProcessorGraph graph;
+    //independent nodes are rendered in parallel, see CabbageParallelGraph
+    CabbageParallelGraph graph;
 	OwnedArray<PluginWindow> activePluginWindows;
 private:
     //==============================================================================
@@ -392,6 +397,31 @@ private:
     NodeID lastUID;
     NodeID getNextUID() noexcept;
 
+    //==============================================================================
+    // Cabbage nodes restored from a saved graph are parsed and compiled on
+    // instantiationPool, then added to the graph on the message thread once
+    // they are ready. Connections are retried as each node arrives.
+    struct PendingCabbageNode
+    {
+        std::unique_ptr<XmlElement> xml;
+        PluginDescription desc;
+        std::unique_ptr<AudioProcessor> processor;
+        int generation;
+    };
+
+    class CabbageInstantiationJob;
+
+    ThreadPool instantiationPool;
+    CriticalSection readyCabbageNodesLock;
+    OwnedArray<PendingCabbageNode> readyCabbageNodes;
+    std::unique_ptr<XmlElement> pendingConnections;
+    int numPendingCabbageNodes = 0;
+    Atomic<int> restoreGeneration;
+
+    void scheduleCabbageNode (const XmlElement& xml, const PluginDescription& desc);
+    void cabbageNodeReady (PendingCabbageNode* node);
+    void handleAsyncUpdate() override;
+
     void createNodeFromXml (const XmlElement& xml);
     void addFilterCallback (AudioPluginInstance*, const String& error, Point<double>);
     void changeListenerCallback (ChangeBroadcaster*) override;
@@ -0,0 +1,155 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEINTERLEAVE_H_INCLUDED
+#define CABBAGEINTERLEAVE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#endif
+
+//==============================================================================
+// Moves audio between the host's float channels and Csound's interleaved spin
+// and spout buffers, scaling by 0dBFS on the way. With SSE2 and a double MYFLT,
+// mono and stereo instruments, which are nearly all of them, are converted two
+// and four samples at a time. Other channel counts, or other sample types, use
+// the plain strided loops.
+//==============================================================================
+struct CabbageInterleave
+{
+    //one host channel into every stride'th element of dest
+    template <typename SampleType>
+    static void interleave (SampleType* dest, int stride, const float* source, int numSamples, SampleType scale)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i * stride] = source[i] * scale;
+    }
+
+    template <typename SampleType>
+    static void deinterleave (float* dest, const SampleType* source, int stride, int numSamples, SampleType scale)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] = float (source[i * stride] * scale);
+    }
+
+    //two host channels into frames of two
+    template <typename SampleType>
+    static void interleavePair (SampleType* dest, const float* left, const float* right, int numSamples, SampleType scale)
+    {
+        interleave (dest, 2, left, numSamples, scale);
+        interleave (dest + 1, 2, right, numSamples, scale);
+    }
+
+    template <typename SampleType>
+    static void deinterleavePair (float* left, float* right, const SampleType* source, int numSamples, SampleType scale)
+    {
+        deinterleave (left, source, 2, numSamples, scale);
+        deinterleave (right, source + 1, 2, numSamples, scale);
+    }
+
+#if JUCE_USE_SSE_INTRINSICS
+    static void interleave (double* dest, int stride, const float* source, int numSamples, double scale)
+    {
+        if (stride != 1)
+        {
+            interleave<double> (dest, stride, source, numSamples, scale);
+            return;
+        }
+
+        const __m128d scales = _mm_set1_pd (scale);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const __m128 samples = _mm_loadu_ps (source + i);
+            _mm_storeu_pd (dest + i,     _mm_mul_pd (_mm_cvtps_pd (samples), scales));
+            _mm_storeu_pd (dest + i + 2, _mm_mul_pd (_mm_cvtps_pd (_mm_movehl_ps (samples, samples)), scales));
+        }
+
+        interleave<double> (dest + i, 1, source + i, numSamples - i, scale);
+    }
+
+    static void deinterleave (float* dest, const double* source, int stride, int numSamples, double scale)
+    {
+        if (stride != 1)
+        {
+            deinterleave<double> (dest, source, stride, numSamples, scale);
+            return;
+        }
+
+        const __m128d scales = _mm_set1_pd (scale);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const __m128 low  = _mm_cvtpd_ps (_mm_mul_pd (_mm_loadu_pd (source + i), scales));
+            const __m128 high = _mm_cvtpd_ps (_mm_mul_pd (_mm_loadu_pd (source + i + 2), scales));
+            _mm_storeu_ps (dest + i, _mm_movelh_ps (low, high));
+        }
+
+        deinterleave<double> (dest + i, source + i, 1, numSamples - i, scale);
+    }
+
+    static void interleavePair (double* dest, const float* left, const float* right, int numSamples, double scale)
+    {
+        const __m128d scales = _mm_set1_pd (scale);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const __m128 l = _mm_loadu_ps (left + i);
+            const __m128 r = _mm_loadu_ps (right + i);
+            const __m128d lLow = _mm_cvtps_pd (l), lHigh = _mm_cvtps_pd (_mm_movehl_ps (l, l));
+            const __m128d rLow = _mm_cvtps_pd (r), rHigh = _mm_cvtps_pd (_mm_movehl_ps (r, r));
+            double* frame = dest + 2 * i;
+
+            _mm_storeu_pd (frame,     _mm_mul_pd (_mm_unpacklo_pd (lLow, rLow), scales));
+            _mm_storeu_pd (frame + 2, _mm_mul_pd (_mm_unpackhi_pd (lLow, rLow), scales));
+            _mm_storeu_pd (frame + 4, _mm_mul_pd (_mm_unpacklo_pd (lHigh, rHigh), scales));
+            _mm_storeu_pd (frame + 6, _mm_mul_pd (_mm_unpackhi_pd (lHigh, rHigh), scales));
+        }
+
+        interleavePair<double> (dest + 2 * i, left + i, right + i, numSamples - i, scale);
+    }
+
+    static void deinterleavePair (float* left, float* right, const double* source, int numSamples, double scale)
+    {
+        const __m128d scales = _mm_set1_pd (scale);
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const double* frame = source + 2 * i;
+            const __m128d f0 = _mm_mul_pd (_mm_loadu_pd (frame),     scales);
+            const __m128d f1 = _mm_mul_pd (_mm_loadu_pd (frame + 2), scales);
+            const __m128d f2 = _mm_mul_pd (_mm_loadu_pd (frame + 4), scales);
+            const __m128d f3 = _mm_mul_pd (_mm_loadu_pd (frame + 6), scales);
+
+            _mm_storeu_ps (left + i,  _mm_movelh_ps (_mm_cvtpd_ps (_mm_unpacklo_pd (f0, f1)), _mm_cvtpd_ps (_mm_unpacklo_pd (f2, f3))));
+            _mm_storeu_ps (right + i, _mm_movelh_ps (_mm_cvtpd_ps (_mm_unpackhi_pd (f0, f1)), _mm_cvtpd_ps (_mm_unpackhi_pd (f2, f3))));
+        }
+
+        deinterleavePair<double> (left + i, right + i, source + 2 * i, numSamples - i, scale);
+    }
+#endif
+};
+
+#endif  // CABBAGEINTERLEAVE_H_INCLUDED
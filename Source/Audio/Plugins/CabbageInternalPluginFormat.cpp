@@ -38,16 +38,32 @@ void InternalCabbagePluginFormat::createPluginInstance(const PluginDescription&
 	else
 		callback(nullptr, NEEDS_TRANS("Invalid internal plugin name"));*/
 
-	std::unique_ptr < AudioProcessor > p(createCabbagePlugin(desc.fileOrIdentifier));
-	std::unique_ptr <AudioPluginInstance> p1(dynamic_cast<AudioPluginInstance*>(p.get()));
+	const String file = desc.fileOrIdentifier;
 
-	//p-> = AudioProcessorGraph::NodeID(desc.uid);
-	callback(std::move(p1), {});
+	//the csd is parsed and compiled on the pool, the callback is always made on the message thread
+	instantiationPool.addJob([this, file, callback]()
+	{
+		std::unique_ptr < AudioProcessor > p(createCabbagePlugin(file));
+		AudioPluginInstance* instance = dynamic_cast<AudioPluginInstance*>(p.get());
+
+		if (instance != nullptr)
+			p.release();
+
+		MessageManager::callAsync([instance, callback]()
+		{
+			std::unique_ptr <AudioPluginInstance> p1(instance);
+
+			if (p1 != nullptr)
+				callback(std::move(p1), {});
+			else
+				callback(nullptr, NEEDS_TRANS("Could not create Cabbage plugin instance"));
+		});
+	});
 }
 
 bool InternalCabbagePluginFormat::requiresUnblockedMessageThreadDuringCreation(const PluginDescription&) const noexcept
 {
-	return false;
+	return true;
 }
 bool requiresUnblockedMessageThreadDuringCreation(const PluginDescription&)
 {
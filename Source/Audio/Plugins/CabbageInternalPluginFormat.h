@@ -23,7 +23,7 @@ class InternalCabbagePluginFormat : public AudioPluginFormat
 public:
 	//==============================================================================
 	InternalCabbagePluginFormat() {};
-	~InternalCabbagePluginFormat() {}
+	~InternalCabbagePluginFormat() { instantiationPool.removeAllJobs(true, -1); }
 
 	//==============================================================================
 	PluginDescription cabbagePluginDesc;
@@ -61,13 +61,13 @@ public:
 
 	std::unique_ptr < GenericCabbagePluginProcessor> createGenericPluginFilter(File inputFile)
 	{
-		const int numChannels = CabbageUtilities::getHeaderInfo(inputFile.loadFileAsString(), "nchnls");
+		const int numChannels = CsdDocument::load(inputFile)->getNumChannels();
 		return std::unique_ptr < GenericCabbagePluginProcessor>(new GenericCabbagePluginProcessor(inputFile, numChannels, numChannels));
 	}
 
 	std::unique_ptr<CabbagePluginProcessor> createCabbagePluginFilter(File inputFile)
 	{
-		const int numChannels = CabbageUtilities::getHeaderInfo(inputFile.loadFileAsString(), "nchnls");
+		const int numChannels = CsdDocument::load(inputFile)->getNumChannels();
 		return std::unique_ptr<CabbagePluginProcessor>(new CabbagePluginProcessor(inputFile, numChannels, numChannels));
 	}
 
@@ -79,4 +79,7 @@ private:
 	std::unique_ptr < AudioProcessor> createCabbagePlugin(const String file);
 
 	bool requiresUnblockedMessageThreadDuringCreation(const PluginDescription&) const noexcept override;
+
+	//instances are parsed and compiled here, one per core, so a graph full of them loads in parallel
+	ThreadPool instantiationPool;
 };
\ No newline at end of file
@@ -0,0 +1,165 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGELOCKFREEFIFO_H_INCLUDED
+#define CABBAGELOCKFREEFIFO_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Single producer, single consumer queue of fixed capacity. push() fails rather
+// than grows when the queue is full. setCapacity() allocates and must not run
+// while either side is in use.
+//==============================================================================
+template <typename ElementType>
+class CabbageLockFreeQueue
+{
+public:
+    CabbageLockFreeQueue() {}
+    ~CabbageLockFreeQueue() {}
+
+    void setCapacity (int numElements)
+    {
+        fifo.setTotalSize (numElements + 1);
+        elements.assign (size_t (numElements + 1), ElementType());
+    }
+
+    void clear()                                { fifo.reset(); }
+    int getNumReady() const                     { return fifo.getNumReady(); }
+
+    bool push (const ElementType& element)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (1, start1, size1, start2, size2);
+
+        if (size1 == 0)
+            return false;
+
+        elements[start1] = element;
+        fifo.finishedWrite (1);
+        return true;
+    }
+
+    //the oldest element, left in the queue
+    const ElementType* peek() const
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (1, start1, size1, start2, size2);
+        return size1 > 0 ? &elements[size_t (start1)] : nullptr;
+    }
+
+    bool pop (ElementType& element)
+    {
+        if (const ElementType* next = peek())
+        {
+            element = *next;
+            fifo.finishedRead (1);
+            return true;
+        }
+
+        return false;
+    }
+
+    void discardNext()
+    {
+        fifo.finishedRead (1);
+    }
+
+private:
+    AbstractFifo fifo { 1 };
+    std::vector<ElementType> elements;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageLockFreeQueue)
+};
+
+//==============================================================================
+// Single producer, single consumer multichannel audio ring buffer.
+//==============================================================================
+class CabbageAudioFifo
+{
+public:
+    CabbageAudioFifo() {}
+    ~CabbageAudioFifo() {}
+
+    void setSize (int numberOfChannels, int capacity)
+    {
+        fifo.setTotalSize (capacity + 1);
+        buffer.setSize (jmax (1, numberOfChannels), capacity + 1);
+        buffer.clear();
+    }
+
+    void clear()                                { fifo.reset(); }
+    int getNumReady() const                     { return fifo.getNumReady(); }
+    int getFreeSpace() const                    { return fifo.getFreeSpace(); }
+    int getNumChannels() const                  { return buffer.getNumChannels(); }
+
+    //channels the source doesn't have are written as silence, source may be nullptr for all silence
+    int write (const float* const* source, int numSourceChannels, int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (numSamples, start1, size1, start2, size2);
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            if (source != nullptr && channel < numSourceChannels)
+            {
+                buffer.copyFrom (channel, start1, source[channel], size1);
+                buffer.copyFrom (channel, start2, source[channel] + size1, size2);
+            }
+            else
+            {
+                buffer.clear (channel, start1, size1);
+                buffer.clear (channel, start2, size2);
+            }
+        }
+
+        fifo.finishedWrite (size1 + size2);
+        return size1 + size2;
+    }
+
+    int read (float* const* dest, int numDestChannels, int startSample, int numSamples)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (numSamples, start1, size1, start2, size2);
+
+        for (int channel = 0; channel < jmin (numDestChannels, buffer.getNumChannels()); ++channel)
+        {
+            FloatVectorOperations::copy (dest[channel] + startSample, buffer.getReadPointer (channel, start1), size1);
+            FloatVectorOperations::copy (dest[channel] + startSample + size1, buffer.getReadPointer (channel, start2), size2);
+        }
+
+        fifo.finishedRead (size1 + size2);
+        return size1 + size2;
+    }
+
+    int discard (int numSamples)
+    {
+        const int numToDiscard = jmin (numSamples, fifo.getNumReady());
+        fifo.finishedRead (numToDiscard);
+        return numToDiscard;
+    }
+
+private:
+    AbstractFifo fifo { 1 };
+    AudioBuffer<float> buffer;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageAudioFifo)
+};
+
+#endif  // CABBAGELOCKFREEFIFO_H_INCLUDED
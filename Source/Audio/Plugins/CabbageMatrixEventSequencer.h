@@ -0,0 +1,187 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEMATRIXEVENTSEQUENCER_H_INCLUDED
+#define CABBAGEMATRIXEVENTSEQUENCER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <csound.hpp>
+#include "CabbageSnapshotBuffer.h"
+
+//==============================================================================
+// A score line parsed once, off the audio thread. Lines made up only of numbers
+// are kept as p-fields and sent with csoundScoreEvent(). Anything else, string
+// p-fields or carry symbols for instance, is kept as text for InputMessage().
+//==============================================================================
+struct CabbageScoreEvent
+{
+    enum
+    {
+        maxPFields = 16,
+        maxTextLength = 128
+    };
+
+    char type;          //0 for an empty cell
+    bool isNumeric;
+    int numPFields;
+    MYFLT pFields[maxPFields];
+    char text[maxTextLength];
+
+    //returns false if the line is too long to be stored
+    static bool parse (const String& scoreLine, CabbageScoreEvent& event)
+    {
+        event.type = 0;
+        event.isNumeric = false;
+        event.numPFields = 0;
+        event.text[0] = 0;
+
+        const String line = scoreLine.upToFirstOccurrenceOf (";", false, false).trim();
+
+        if (line.isEmpty())
+            return true;
+
+        if (line.getNumBytesAsUTF8() >= maxTextLength)
+            return false;
+
+        line.copyToUTF8 (event.text, maxTextLength);
+        event.type = (char) line[0];
+
+        StringArray tokens;
+        tokens.addTokens (line.substring (1), " \t", "\"");
+        tokens.removeEmptyStrings();
+
+        event.isNumeric = tokens.size() <= maxPFields;
+
+        for (int i = 0; i < tokens.size() && event.isNumeric; i++)
+        {
+            if (tokens[i].containsOnly ("0123456789.-+eE") && tokens[i].containsAnyOf ("0123456789"))
+                event.pFields[event.numPFields++] = tokens[i].getDoubleValue();
+            else
+                event.isNumeric = false;
+        }
+
+        return true;
+    }
+};
+
+//==============================================================================
+// Grid of score events stepped through by a Csound channel. Cells are parsed
+// when they are edited and handed to the audio thread through one triple buffer
+// per cell, so triggerEvents() only reads the position channel through its
+// pointer and passes ready made events to Csound. Vertical sequencers step
+// through rows and fire one event per column, horizontal ones the other way round.
+// Events are issued at the start of the k-cycle following the position change,
+// keeping whatever p2 offset the cell was written with.
+//==============================================================================
+class CabbageMatrixEventSequencer
+{
+public:
+    CabbageMatrixEventSequencer (const String& csoundChannel, int numberOfColumns, int numberOfRows, bool isVertical)
+        : channel (csoundChannel),
+          numColumns (jmax (0, numberOfColumns)),
+          numRows (jmax (0, numberOfRows)),
+          vertical (isVertical)
+    {
+        for (int i = 0; i < numColumns * numRows; i++)
+            cells.add (new CabbageSnapshotBuffer<CabbageScoreEvent>())->setSize (1);
+    }
+
+    ~CabbageMatrixEventSequencer() {}
+
+    const String& getChannel() const noexcept       { return channel; }
+
+    //==============================================================================
+    // message thread
+    void setCellData (int col, int row, const String& data)
+    {
+        if (isPositiveAndBelow (col, numColumns) == false || isPositiveAndBelow (row, numRows) == false)
+            return;
+
+        CabbageSnapshotBuffer<CabbageScoreEvent>* cell = cells.getUnchecked (col * numRows + row);
+
+        if (CabbageScoreEvent::parse (data, *cell->getWriteBuffer()))
+            cell->publish();
+        else
+            Logger::writeToLog ("Score event too long for event sequencer \"" + channel + "\": " + data);
+    }
+
+    //looked up before an instance is swapped in, and handed over with setPositionChannel() as it is
+    MYFLT* findPositionChannel (Csound& csound) const
+    {
+        MYFLT* channelPtr = nullptr;
+
+        if (csound.GetChannelPtr (channelPtr, channel.toUTF8(), CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL) != 0)
+            return nullptr;
+
+        return channelPtr;
+    }
+
+    void setPositionChannel (MYFLT* channelPtr)
+    {
+        positionChannel = channelPtr;
+    }
+
+    //==============================================================================
+    // audio thread, called once per k-cycle
+    void triggerEvents (Csound& csound)
+    {
+        if (positionChannel == nullptr)
+            return;
+
+        const int newPosition = int (*positionChannel);
+
+        if (newPosition == position)
+            return;
+
+        position = newPosition;
+
+        if (isPositiveAndBelow (position, vertical ? numRows : numColumns) == false)
+            return;
+
+        const int numEvents = vertical ? numColumns : numRows;
+
+        for (int i = 0; i < numEvents; i++)
+        {
+            CabbageSnapshotBuffer<CabbageScoreEvent>* cell = vertical ? cells.getUnchecked (i * numRows + position)
+                                                                      : cells.getUnchecked (position * numRows + i);
+            cell->acquire();
+            const CabbageScoreEvent& event = *cell->getReadBuffer();
+
+            if (event.type == 0)
+                continue;
+
+            if (event.isNumeric)
+                csound.ScoreEvent (event.type, event.pFields, event.numPFields);
+            else
+                csound.InputMessage (event.text);
+        }
+    }
+
+private:
+    String channel;
+    int numColumns, numRows;
+    bool vertical;
+    OwnedArray<CabbageSnapshotBuffer<CabbageScoreEvent>> cells;
+    MYFLT* positionChannel = nullptr;
+    int position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageMatrixEventSequencer)
+};
+
+#endif  // CABBAGEMATRIXEVENTSEQUENCER_H_INCLUDED
@@ -0,0 +1,135 @@
+/*
+  Copyright (C) 2016 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEMIDIFIFO_H_INCLUDED
+#define CABBAGEMIDIFIFO_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Fixed capacity list of MIDI events, sysex included, for use on the audio thread.
+// Storage is allocated once up front. Events that don't fit are dropped and
+// counted rather than grown into. Events are read back in the order they were
+// added, and compact() moves anything left unread to the front, due at sample 0.
+//==============================================================================
+class CabbageMidiFifo
+{
+public:
+    CabbageMidiFifo (int maxNumEvents = 2048, int maxNumBytes = 65536)
+        : maxEvents (maxNumEvents), maxBytes (maxNumBytes)
+    {
+        events.malloc ((size_t) maxEvents);
+        bytes.malloc ((size_t) maxBytes);
+    }
+
+    ~CabbageMidiFifo() {}
+
+    bool addEvent (const uint8* data, int numBytes, int samplePosition)
+    {
+        if (numBytes <= 0 || numEvents == maxEvents || numBytesUsed + numBytes > maxBytes)
+        {
+            ++numDropped;
+            return false;
+        }
+
+        memcpy (bytes + numBytesUsed, data, (size_t) numBytes);
+        events[numEvents++] = { samplePosition, numBytesUsed, numBytes };
+        numBytesUsed += numBytes;
+        return true;
+    }
+
+    //returns the next unread event without consuming it
+    bool getNextEvent (const uint8*& data, int& numBytes, int& samplePosition) const
+    {
+        if (readIndex == numEvents)
+            return false;
+
+        const Event& e = events[readIndex];
+        data = bytes + e.offset;
+        numBytes = e.numBytes;
+        samplePosition = e.samplePosition;
+        return true;
+    }
+
+    void readNextEvent()
+    {
+        jassert (readIndex < numEvents);
+        ++readIndex;
+    }
+
+    //consumes the next event and counts it as lost
+    void dropNextEvent()
+    {
+        readNextEvent();
+        ++numDropped;
+    }
+
+    bool isEmpty() const
+    {
+        return readIndex == numEvents;
+    }
+
+    void compact()
+    {
+        if (readIndex == 0)
+        {
+            for (int i = 0; i < numEvents; i++)
+                events[i].samplePosition = 0;
+
+            return;
+        }
+
+        const int firstByte = (readIndex < numEvents ? events[readIndex].offset : numBytesUsed);
+
+        for (int i = readIndex; i < numEvents; i++)
+            events[i - readIndex] = { 0, events[i].offset - firstByte, events[i].numBytes };
+
+        memmove (bytes, bytes + firstByte, (size_t) (numBytesUsed - firstByte));
+        numEvents -= readIndex;
+        numBytesUsed -= firstByte;
+        readIndex = 0;
+    }
+
+    void clear()
+    {
+        numEvents = numBytesUsed = readIndex = 0;
+    }
+
+    //total number of events dropped since the fifo was created
+    int getNumDropped() const
+    {
+        return numDropped;
+    }
+
+private:
+    struct Event
+    {
+        int samplePosition, offset, numBytes;
+    };
+
+    HeapBlock<Event> events;
+    HeapBlock<uint8> bytes;
+    const int maxEvents, maxBytes;
+    int numEvents = 0, numBytesUsed = 0, readIndex = 0;
+    int numDropped = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageMidiFifo)
+};
+
+#endif  // CABBAGEMIDIFIFO_H_INCLUDED
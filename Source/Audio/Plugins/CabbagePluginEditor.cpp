@@ -156,6 +156,7 @@ void CabbagePluginEditor::handleMouseClicks (const MouseEvent& e, bool isMousePr
 void CabbagePluginEditor::createEditorInterface (ValueTree widgets)
 {
     components.clear();
+    componentIndex.clear();
 
     for (int widget = 0; widget < widgets.getNumChildren(); widget++)
     {
@@ -593,16 +594,7 @@ void CabbagePluginEditor::insertLight (ValueTree cabbageWidgetData)
 //======================================================================================================
 CabbageAudioParameter* CabbagePluginEditor::getParameterForComponent (const String name)
 {
-    for (auto param : processor.getParameters())
-    {
-        if (CabbageAudioParameter* cabbageParam = dynamic_cast<CabbageAudioParameter*> (param))
-        {
-            if (name == cabbageParam->getWidgetName())
-                return dynamic_cast<CabbageAudioParameter*> (cabbageParam);
-        }
-    }
-
-    return nullptr;
+    return processor.getParameterForWidget (name);
 }
 
 //======================================================================================================
@@ -630,7 +622,7 @@ void CabbagePluginEditor::buttonClicked(Button* button)
 	if (CabbageButton* cabbageButton = dynamic_cast<CabbageButton*> (button))
 	{
 		const StringArray textItems = cabbageButton->getTextArray();
-		const ValueTree valueTree = CabbageWidgetData::getValueTreeForComponent(processor.cabbageWidgets, cabbageButton->getName());
+		const ValueTree valueTree = processor.getWidgetForName (cabbageButton->getName());
 		const int latched = CabbageWidgetData::getNumProp(valueTree, CabbageIdentifierIds::latched);
 
 		if (textItems.size() > 0)
@@ -644,7 +636,7 @@ void CabbagePluginEditor::buttonClicked(Button* button)
 	else if (CabbageCheckbox* cabbageButton = dynamic_cast<CabbageCheckbox*> (button))
 	{
 		const StringArray textItems = cabbageButton->getTextArray();
-		const ValueTree valueTree = CabbageWidgetData::getValueTreeForComponent(processor.cabbageWidgets, cabbageButton->getName());
+		const ValueTree valueTree = processor.getWidgetForName (cabbageButton->getName());
 		// const int latched = CabbageWidgetData::getNumProp(valueTree, CabbageIdentifierIds::latched);
 
 		if (textItems.size() > 0)
@@ -661,7 +653,7 @@ void CabbagePluginEditor::buttonStateChanged(Button* button)
 {
 	if (CabbageButton* cabbageButton = dynamic_cast<CabbageButton*> (button))
 	{
-		const ValueTree valueTree = CabbageWidgetData::getValueTreeForComponent(processor.cabbageWidgets, cabbageButton->getName());
+		const ValueTree valueTree = processor.getWidgetForName (cabbageButton->getName());
 		const int latched = CabbageWidgetData::getNumProp(valueTree, CabbageIdentifierIds::latched);
 
 		if (latched == 0)
@@ -748,10 +740,22 @@ void CabbagePluginEditor::resetCurrentlySelectedComponents()
 
 Component* CabbagePluginEditor::getComponentFromName (String name)
 {
+    if (name.isEmpty())
+        return nullptr;
+
+    //components are only ever removed all at once, so an indexed pointer is live
+    //unless the component has since been renamed in the editor
+    if (Component* comp = componentIndex[name])
+        if (name == comp->getName())
+            return comp;
+
     for (auto comp : components)
     {
         if (name == comp->getName())
+        {
+            componentIndex.set (name, comp);
             return comp;
+        }
     }
 
     return nullptr;
@@ -762,7 +766,7 @@ Array<ValueTree> CabbagePluginEditor::getValueTreesForCurrentlySelectedComponent
     Array<ValueTree> valueTreeArray;
 
     for (String compName : currentlySelectedComponentNames)
-        valueTreeArray.add (CabbageWidgetData::getValueTreeForComponent (processor.cabbageWidgets, compName));
+        valueTreeArray.add (processor.getWidgetForName (compName));
 
     return valueTreeArray;
 }
@@ -772,10 +776,10 @@ ValueTree CabbagePluginEditor::getValueTreeForComponent (String compName)
     if(compName == "form")//special case
     {
         resetCurrentlySelectedComponents();
-        return CabbageWidgetData::getValueTreeForComponent (processor.cabbageWidgets, "form");
+        return processor.getWidgetForName ("form");
     }
     else
-        return CabbageWidgetData::getValueTreeForComponent (processor.cabbageWidgets, getComponentFromName (compName)->getName());
+        return processor.getWidgetForName (getComponentFromName (compName)->getName());
 }
 
 void CabbagePluginEditor::updateLayoutEditorFrames()
@@ -793,6 +797,8 @@ void CabbagePluginEditor::addToEditorAndMakeVisible (Component* comp, ValueTree
 {
     const String parent = CabbageWidgetData::getStringProp (widgetData, CabbageIdentifierIds::parentcomponent);
 
+    if (componentIndex.contains (comp->getName()) == false)
+        componentIndex.set (comp->getName(), comp);
 
     if (auto parentComp = getComponentFromName (parent))
     {
@@ -927,10 +933,10 @@ void CabbagePluginEditor::sendScoreEventToCsound (String scoreEvent)
         processor.getCsound()->InputMessage(scoreEvent.toUTF8());
 }
 
-void CabbagePluginEditor::createEventMatrix(int cols, int rows, String channel)
+void CabbagePluginEditor::createEventMatrix(int cols, int rows, String channel, bool vertical)
 {
     if (processor.csdCompiledWithoutError())
-        processor.createMatrixEventSequencer(cols, rows, channel);
+        processor.createMatrixEventSequencer(cols, rows, channel, vertical);
 }
 
 void CabbagePluginEditor::setEventMatrixData(int cols, int rows, String channel, String data)
@@ -940,17 +946,12 @@ void CabbagePluginEditor::setEventMatrixData(int cols, int rows, String channel,
 }
 
 
-const Array<float, CriticalSection> CabbagePluginEditor::getArrayForSignalDisplay (const String signalVariable, const String displayType)
+bool CabbagePluginEditor::getArrayForSignalDisplay (const String signalVariable, const String displayType, Array<float>& points)
 {
     if (csdCompiledWithoutError())
-        return processor.getSignalArray (signalVariable, displayType)->getPoints();
+        return processor.getSignalArray (signalVariable, displayType)->getPoints (points);
 
-    return Array<float, CriticalSection>();
-}
-
-bool CabbagePluginEditor::shouldUpdateSignalDisplay()
-{
-    return processor.shouldUpdateSignalDisplay();
+    return false;
 }
 
 void CabbagePluginEditor::enableXYAutomator (String name, bool enable, Line<float> dragLine)
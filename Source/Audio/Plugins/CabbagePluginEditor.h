@@ -132,17 +132,16 @@ public:
     void sendChannelStringDataToCsound (String channel, String value);
     float getChannelDataFromCsound (String channel);
     void sendScoreEventToCsound (String scoreEvent);
-    void createEventMatrix(int cols, int rows, String channel);
+    void createEventMatrix(int cols, int rows, String channel, bool vertical = true);
     void setEventMatrixData(int cols, int rows, String channel, String data);
     void setEventMatrixCurrentPosition(int cols, int rows, String channel, int position);
     bool isAudioUnit()
     {
         return processor.wrapperType_AudioUnit;
     }
-    bool shouldUpdateSignalDisplay();
     void savePluginStateToFile (File snapshotFile, String presetName="");
     void restorePluginStateFrom (String childPreset, File xmlFile);
-    const Array<float, CriticalSection> getArrayForSignalDisplay (const String signalVariable, const String displayType);
+    bool getArrayForSignalDisplay (const String signalVariable, const String displayType, Array<float>& points);
     const String getCsoundOutputFromProcessor();
     StringArray getTableStatement (int tableNumber);
     bool csdCompiledWithoutError();
@@ -287,6 +286,7 @@ private:
     std::unique_ptr<Viewport> viewport;
     std::unique_ptr<ViewportContainer> viewportContainer;
     OwnedArray<Component> components;
+    HashMap<String, Component*> componentIndex;   //by name, see getComponentFromName()
     Array<Component*> radioComponents;
     OwnedArray<PopupDocumentWindow> popupPlants;
     String lastOpenedDirectory;
@@ -20,9 +20,6 @@
 #include "CabbagePluginProcessor.h"
 #include "CabbagePluginEditor.h"
 
-char tmp_string[4096] = {0};
-char channelMessage[4096] = {0};
-
 AudioProcessor *JUCE_CALLTYPE
 
 createPluginFilter()
@@ -41,7 +38,7 @@ createPluginFilter()
 	if (csdFile.existsAsFile() == false)
 		Logger::writeToLog("Could not find " + csdPath);
 
-    const int numChannels = CabbageUtilities::getHeaderInfo(csdFile.loadFileAsString(), "nchnls");
+    const int numChannels = CsdDocument::load(csdFile)->getNumChannels();
     return new CabbagePluginProcessor(csdFile, numChannels, numChannels);
 };
 
@@ -51,6 +48,8 @@ CabbagePluginProcessor::CabbagePluginProcessor(File inputFile, const int ins, co
           csdFile(inputFile),
           cabbageWidgets("CabbageWidgetData") 
 {
+    widgetIndex.attachTo(cabbageWidgets);
+    polledChannelValues.attachTo(cabbageWidgets);
     setPluginName(inputFile.getFileNameWithoutExtension());
 	createCsound(inputFile);
 }
@@ -60,49 +59,156 @@ void CabbagePluginProcessor::createCsound(File inputFile, bool shouldCreateParam
 {
     CabbageUtilities::debug(csdFile.getFullPathName());
     if (inputFile.existsAsFile()) {
+        sourceCsdFile = inputFile;
         setWidthHeight();
-        StringArray linesFromCsd;
-        linesFromCsd.addLines(inputFile.loadFileAsString());
 
-        //only create extended temp file if imported plants are being added...
-        if( addImportFiles(linesFromCsd) == true )
+        //another instance has already done the preprocessing for this file
+        if (auto cachedDocument = restoreFromInstrumentCache(inputFile))
         {
-            parseCsdFile(linesFromCsd);
-
-
-            File tempFile = File::createTempFile(inputFile.getFileNameWithoutExtension()+"_temp.csd");
-            tempFile.replaceWithText(linesFromCsd.joinIntoString("\n")
-                                             .replace("$lt;", "<")
-                                             .replace("&amp;", "&")
-                                             .replace("$quote;", "\"")
-                                             .replace("$gt;", ">"));
-
-
-
-
-            if (setupAndCompileCsound(tempFile, inputFile.getParentDirectory(), samplingRate) == false)
+            if (setupAndCompileCsound(cachedDocument, inputFile, inputFile.getParentDirectory(), samplingRate) == false)
                 this->suspendProcessing(true);
-            
-                csdFile = tempFile;
-            
         }
-        
-        else{
-            parseCsdFile(linesFromCsd);
-            csdFile = inputFile;
-            if (setupAndCompileCsound(inputFile, inputFile.getParentDirectory(), samplingRate) == false)
+        else
+        {
+            const File fileToCompile = prepareCsdForCompile(inputFile);
+
+            if (setupAndCompileCsound(fileToCompile, inputFile.getParentDirectory(), samplingRate) == false)
                 this->suspendProcessing(true);
+
+            if (csdCompiledWithoutError())
+                addToInstrumentCache(inputFile);
         }
         
-        if (shouldCreateParameters)
+        if (shouldCreateParameters) {
             createParameters();
 
+            if (csdCompiledWithoutError())
+                resolveChannelPointers(*getCsound());
+        }
+
         csoundChanList = NULL;
 
         initAllCsoundChannels(cabbageWidgets);
-        
-        csdLastModifiedAt = csdFile.getLastModificationTime().toMilliseconds();
+        buildChannelTable();
+    }
+}
+
+//parses the csd into the widget tree, and returns the file Csound should compile,
+//a temp file with the plant code expanded if plants are imported
+File CabbagePluginProcessor::prepareCsdForCompile(File inputFile)
+{
+    StringArray linesFromCsd (CsdDocument::load(inputFile)->getLines());
+
+    //only create extended temp file if imported plants are being added...
+    if( addImportFiles(linesFromCsd) == true )
+    {
+        parseCsdFile(linesFromCsd);
+
+
+        File tempFile = File::createTempFile(inputFile.getFileNameWithoutExtension()+"_temp.csd");
+        tempFile.replaceWithText(linesFromCsd.joinIntoString("\n")
+                                         .replace("$lt;", "<")
+                                         .replace("&amp;", "&")
+                                         .replace("$quote;", "\"")
+                                         .replace("$gt;", ">"));
+
+        csdFile = tempFile;
+    }
+    else
+    {
+        parseCsdFile(linesFromCsd);
+        csdFile = inputFile;
+    }
+
+    return csdFile;
+}
+
+//==============================================================================
+// Hot reload. The csd is parsed here, on the message thread, and compiled on a
+// background thread while the current instance keeps playing. The widgets take
+// over the values of the widgets they replace, and those are sent to the new
+// instance before it is swapped in. If it fails to compile the old one carries on.
+//==============================================================================
+void CabbagePluginProcessor::watchedFileChanged(const File&)
+{
+    CabbageUtilities::debug("reloading instrument due to update of file on disk");
+    reloadCsound();
+}
+
+void CabbagePluginProcessor::reloadCsound()
+{
+    if (sourceCsdFile.existsAsFile() == false)
+        return;
+
+    //saves made while compiling are picked up once it is done
+    if (isCompilingInBackground())
+    {
+        reloadPending = true;
+        return;
+    }
+
+    const ValueTree oldWidgets = cabbageWidgets.createCopy();
+    setWidthHeight();
+    parsingReload = true;
+    const File fileToCompile = prepareCsdForCompile(sourceCsdFile);
+    parsingReload = false;
+    //the cache holds the csd's own defaults, not this instance's current values
+    reloadParsedWidgets = cabbageWidgets.createCopy();
+    migrateWidgetValues(oldWidgets);
+
+    compileCsoundInBackground(fileToCompile, sourceCsdFile.getParentDirectory(), samplingRate);
+}
+
+void CabbagePluginProcessor::backgroundCompileFinished(CompiledCsound& compiled)
+{
+    if (compiled.compileResult == 0)
+    {
+        initAllCsoundChannels(cabbageWidgets, compiled);
+        compiled.renderAhead = reloadRenderAhead;
+        installCsound(compiled, true);
+        suspendProcessing(false);
+        buildChannelTable();
+        addToInstrumentCache(sourceCsdFile, reloadParsedWidgets);
+    }
+    else
+        CabbageUtilities::debug("Csound could not compile your file, the previous version keeps running");
+
+    reloadParsedWidgets = ValueTree();
+    reloadRenderAhead = -1;
+
+    if (reloadPending)
+    {
+        reloadPending = false;
+        reloadCsound();
+    }
+}
+
+//widgets keep their current values across a reload if their type and channel are unchanged
+void CabbagePluginProcessor::migrateWidgetValues(ValueTree oldWidgets)
+{
+    const Identifier valueIds[] = { CabbageIdentifierIds::value, CabbageIdentifierIds::valuex, CabbageIdentifierIds::valuey,
+                                    CabbageIdentifierIds::minvalue, CabbageIdentifierIds::maxvalue,
+                                    CabbageIdentifierIds::text, CabbageIdentifierIds::file };
+    CabbageWidgetIndex oldIndex;
+    oldIndex.attachTo(oldWidgets);
+
+    for (int i = 0; i < cabbageWidgets.getNumChildren(); i++)
+    {
+        ValueTree widget = cabbageWidgets.getChild(i);
+        const var channels = widget.getProperty(CabbageIdentifierIds::channel);
+        const String channel = channels.size() > 0 ? channels[0].toString() : channels.toString();
 
+        if (channel.isEmpty())
+            continue;
+
+        const ValueTree oldWidget = oldIndex.getWidgetForChannel(channel);
+
+        if (oldWidget.getProperty(CabbageIdentifierIds::type) != widget.getProperty(CabbageIdentifierIds::type))
+            continue;
+
+        for (const auto& id : valueIds)
+            if (oldWidget.hasProperty(id))
+                widget.setProperty(id, oldWidget.getProperty(id), nullptr);
     }
 }
 
@@ -116,34 +222,15 @@ CabbagePluginProcessor::~CabbagePluginProcessor() {
 //    cabbageWidgets.removeAllProperties(nullptr);
 }
 
-void CabbagePluginProcessor::timerCallback()
-{
-    int64 modTime = csdFile.getLastModificationTime().toMilliseconds();
-    
-    if (modTime != csdLastModifiedAt && csdFile.existsAsFile())
-    {
-        csdLastModifiedAt = csdFile.getLastModificationTime().toMilliseconds();
-        CabbageUtilities::debug("resetting file due to update of file on disk");
-        createCsound(csdFile, false);
-    }
-}
-
 //==============================================================================
 void CabbagePluginProcessor::setWidthHeight() {
-    StringArray csdLines;
-    csdLines.addLines(csdFile.loadFileAsString());
+    const String formLine = CsdDocument::load(csdFile)->getFormLine();
 
-    for (auto line : csdLines) {
-        if(line.contains("</Cabbage>"))
-            return;
-        
+    if (formLine.isNotEmpty()) {
         ValueTree temp("temp");
-        CabbageWidgetData::setWidgetState(temp, line, 0);
-
-        if (CabbageWidgetData::getStringProp(temp, CabbageIdentifierIds::type) == CabbageWidgetTypes::form) {
-            screenHeight = CabbageWidgetData::getNumProp(temp, CabbageIdentifierIds::height);
-            screenWidth = CabbageWidgetData::getNumProp(temp, CabbageIdentifierIds::width);
-        }
+        CabbageWidgetData::setWidgetState(temp, formLine, 0);
+        screenHeight = CabbageWidgetData::getNumProp(temp, CabbageIdentifierIds::height);
+        screenWidth = CabbageWidgetData::getNumProp(temp, CabbageIdentifierIds::width);
     }
 }
 
@@ -158,7 +245,7 @@ void CabbagePluginProcessor::parseCsdFile(StringArray &linesFromCsd)
         if (CabbageWidgetData::getStringProp(temp, CabbageIdentifierIds::type) == CabbageWidgetTypes::form)
         {
             if (line.contains("autoupdate()"))
-                startTimer(1000);
+                csdFileWatcher.startWatching(sourceCsdFile);
         }
         
     }
@@ -231,15 +318,8 @@ void CabbagePluginProcessor::parseCsdFile(StringArray &linesFromCsd)
                 linesToSkip += plantStructs[i].cabbageCode.size() + 1;
         }
 
-        if (typeOfWidget == CabbageWidgetTypes::form) {
-            const String caption = CabbageWidgetData::getStringProp(tempWidget, CabbageIdentifierIds::caption);
-            setPluginName(caption.length() > 0 ? caption : "Untitled");
-
-            if (CabbageWidgetData::getNumProp(tempWidget, CabbageIdentifierIds::logger) == 1)
-                createFileLogger(this->csdFile);
-
-            setGUIRefreshRate(CabbageWidgetData::getNumProp(tempWidget, CabbageIdentifierIds::guirefresh));
-        }
+        if (typeOfWidget == CabbageWidgetTypes::form)
+            applyFormSettings(tempWidget);
 
         const String precedingCharacters = currentLineOfCabbageCode.substring(0, currentLineOfCabbageCode.indexOf(
                 typeOfWidget));
@@ -283,6 +363,124 @@ void CabbagePluginProcessor::parseCsdFile(StringArray &linesFromCsd)
     }
 }
 
+void CabbagePluginProcessor::applyFormSettings(ValueTree formWidget) {
+    const String caption = CabbageWidgetData::getStringProp(formWidget, CabbageIdentifierIds::caption);
+    setPluginName(caption.length() > 0 ? caption : "Untitled");
+
+    if (CabbageWidgetData::getNumProp(formWidget, CabbageIdentifierIds::logger) == 1)
+        createFileLogger(this->csdFile);
+
+    setGUIRefreshRate(CabbageWidgetData::getNumProp(formWidget, CabbageIdentifierIds::guirefresh));
+    setHostPositionInterpolation(CabbageWidgetData::getNumProp(formWidget, CabbageIdentifierIds::interpolatetransport) == 1);
+    const int renderAhead = CabbageWidgetData::getNumProp(formWidget, CabbageIdentifierIds::renderahead);
+
+    //the instance being replaced keeps playing as it is until the reloaded one is swapped in
+    if (parsingReload)
+        reloadRenderAhead = renderAhead;
+    else
+        setRenderAhead(renderAhead);
+}
+
+//==============================================================================
+// Sessions often load the same instrument many times over. The first instance
+// to compile a file leaves the result of its preprocessing here: the document
+// Csound compiled, with any imported plants expanded, the widget tree and the
+// plant and macro state that goes with it. Later instances with the same file,
+// sample rate and modification times, its own and those of the files it
+// imports, clone the tree and compile the document's text from memory.
+// There is one entry per file.
+//==============================================================================
+namespace
+{
+    struct CachedInstrument
+    {
+        int64 modificationTime;
+        int sampleRate;
+        std::shared_ptr<const CsdDocument> document;
+        Array<File> importedFiles;
+        Array<int64> importModificationTimes;
+        ValueTree widgets;
+        Array<CabbagePluginProcessor::PlantImportStruct> plantStructs;
+        NamedValueSet macroText;
+        var macroNames, macroStrings;
+        int linesToSkip;
+        bool autoUpdate;
+    };
+
+    CriticalSection instrumentCacheLock;
+    HashMap<String, CachedInstrument> instrumentCache;
+
+    Array<int64> getModificationTimes (const Array<File>& files)
+    {
+        Array<int64> times;
+
+        for (auto& file : files)
+            times.add (file.getLastModificationTime().toMilliseconds());
+
+        return times;
+    }
+}
+
+std::shared_ptr<const CsdDocument> CabbagePluginProcessor::restoreFromInstrumentCache(File inputFile) {
+    CachedInstrument cached;
+
+    {
+        const ScopedLock sl(instrumentCacheLock);
+        const String path = inputFile.getFullPathName();
+
+        if (instrumentCache.contains(path) == false)
+            return nullptr;
+
+        cached = instrumentCache[path];
+    }
+
+    if (cached.modificationTime != inputFile.getLastModificationTime().toMilliseconds()
+        || cached.sampleRate != samplingRate || cached.document == nullptr
+        || cached.importModificationTimes != getModificationTimes(cached.importedFiles))
+        return nullptr;
+
+    cabbageWidgets.removeAllChildren(nullptr);
+
+    for (int i = 0; i < cached.widgets.getNumChildren(); i++)
+        cabbageWidgets.addChild(cached.widgets.getChild(i).createCopy(), -1, nullptr);
+
+    plantStructs = cached.plantStructs;
+    macroText = cached.macroText;
+    macroNames = cached.macroNames;
+    macroStrings = cached.macroStrings;
+    linesToSkip = cached.linesToSkip;
+    importedFiles = cached.importedFiles;
+    csdFile = inputFile;
+
+    if (cached.autoUpdate)
+        csdFileWatcher.startWatching(inputFile);
+
+    for (int i = 0; i < cabbageWidgets.getNumChildren(); i++)
+        if (CabbageWidgetData::getStringProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::type) == CabbageWidgetTypes::form)
+            applyFormSettings(cabbageWidgets.getChild(i));
+
+    return cached.document;
+}
+
+void CabbagePluginProcessor::addToInstrumentCache(File inputFile, ValueTree parsedWidgets) {
+    CachedInstrument cached;
+    cached.modificationTime = inputFile.getLastModificationTime().toMilliseconds();
+    cached.sampleRate = samplingRate;
+    cached.document = getCsdDocument();
+    cached.importedFiles = importedFiles;
+    cached.importModificationTimes = getModificationTimes(importedFiles);
+    cached.widgets = parsedWidgets.isValid() ? parsedWidgets.createCopy() : cabbageWidgets.createCopy();
+    cached.plantStructs = plantStructs;
+    cached.macroText = macroText;
+    cached.macroNames = macroNames;
+    cached.macroStrings = macroStrings;
+    cached.linesToSkip = linesToSkip;
+    cached.autoUpdate = csdFileWatcher.isWatching();
+
+    const ScopedLock sl(instrumentCacheLock);
+    instrumentCache.set(inputFile.getFullPathName(), cached);
+}
+
 bool CabbagePluginProcessor::isWidgetPlantParent(StringArray linesFromCsd, int lineNumber) {
     if (linesFromCsd[lineNumber].contains("{"))
         return true;
@@ -304,6 +502,7 @@ bool CabbagePluginProcessor::addImportFiles(StringArray &linesFromCsd) {
 
     getMacros(linesFromCsd);
     bool hasImportFiles = false;
+    importedFiles.clear();
     for (int i = 0; i < linesFromCsd.size(); i++) {
         ValueTree temp("temp");
         String newLine = linesFromCsd[i];
@@ -322,6 +521,7 @@ bool CabbagePluginProcessor::addImportFiles(StringArray &linesFromCsd) {
 //                        csdFile.getParentDirectory().getChildFile(files[y].toString()).getFullPathName());
 
                 if (csdFile.getParentDirectory().getChildFile(files[y].toString()).existsAsFile()) {
+                    importedFiles.add(csdFile.getParentDirectory().getChildFile(files[y].toString()));
                     StringArray linesFromImportedFile;
                     linesFromImportedFile.addLines(
                             csdFile.getParentDirectory().getChildFile(files[y].toString()).loadFileAsString());
@@ -533,9 +733,12 @@ void CabbagePluginProcessor::generateCabbageCodeFromJS(PlantImportStruct &import
 
     importData.cabbageCode.addLines(cabbageScriptGeneratedCode.joinIntoString("\n"));
 
+    //plants can be imported while the processor is created on a worker thread
     if (result.failed())
-        CabbageUtilities::showMessage("javaScript Error:" + result.getErrorMessage(),
-                                      &getActiveEditor()->getLookAndFeel());
+    {
+        const String message = "javaScript Error:" + result.getErrorMessage();
+        MessageManager::callAsync ([message] { CabbageUtilities::showMessage (message, &LookAndFeel::getDefaultLookAndFeel()); });
+    }
 
 }
 
@@ -605,6 +808,7 @@ void CabbagePluginProcessor::updateWidgets(String csdText) {
     StringArray strings;
     strings.addLines(csdText);
     parseCsdFile(strings);
+    buildChannelTable();
     editor->createEditorInterface(cabbageWidgets);
     editor->updateLayoutEditorFrames();
 }
@@ -693,6 +897,16 @@ void CabbagePluginProcessor::createParameters() {
             }
         }
     }
+
+    //index parameters by widget name, the first one added for a name wins
+    parameterIndex.clear();
+
+    for (auto param : getParameters()) {
+        if (CabbageAudioParameter *cabbageParam = dynamic_cast<CabbageAudioParameter *> (param)) {
+            if (parameterIndex.contains(cabbageParam->getWidgetName()) == false)
+                parameterIndex.set(cabbageParam->getWidgetName(), cabbageParam);
+        }
+    }
 }
 
 //==============================================================================
@@ -830,7 +1044,7 @@ void CabbagePluginProcessor::setParametersFromXml(XmlElement *e)
         for (int i = 1; i < e->getNumAttributes(); i++)
         {
 
-            ValueTree valueTree = CabbageWidgetData::getValueTreeForComponent(cabbageWidgets, e->getAttributeName(i), true);
+            ValueTree valueTree = getWidgetForChannel(e->getAttributeName(i));
 
             const String type = CabbageWidgetData::getStringProp(valueTree, CabbageIdentifierIds::type);
             const String widgetName = CabbageWidgetData::getStringProp(valueTree, CabbageIdentifierIds::name);
@@ -868,17 +1082,11 @@ void CabbagePluginProcessor::setParametersFromXml(XmlElement *e)
                                                   e->getAttributeValue(i).getFloatValue());
                     //now make changes parameter changes so host can see them..
                 
-                    for (auto param : getParameters())
+                    if (CabbageAudioParameter* param = getParameterForWidget(widgetName))
                     {
-                        if (CabbageAudioParameter* cabbageParam = dynamic_cast<CabbageAudioParameter*> (param))
-                        {
-                            if (widgetName == cabbageParam->getWidgetName())
-                            {
-                                param->beginChangeGesture();
-                                param->setValueNotifyingHost(((CabbageAudioParameter*)param)->range.convertTo0to1 (e->getAttributeValue(i).getFloatValue()));
-                                param->endChangeGesture();
-                            }
-                        }
+                        param->beginChangeGesture();
+                        param->setValueNotifyingHost(param->range.convertTo0to1 (e->getAttributeValue(i).getFloatValue()));
+                        param->endChangeGesture();
                     }
             }
         }
@@ -886,145 +1094,203 @@ void CabbagePluginProcessor::setParametersFromXml(XmlElement *e)
 }
 
 //==============================================================================
-// This method is responsible for updating widget valuetrees based on the current
-// data stored in each widget's software channel bus. 
+// Works out, once per parse, which widget properties are driven by which Csound
+// channels. Numeric channels are handed to CsoundPluginProcessor to be polled on
+// the audio thread, string and ident channels are still read by name as they
+// can't be snapshotted.
 //==============================================================================
-void CabbagePluginProcessor::getChannelDataFromCsound() 
+void CabbagePluginProcessor::buildChannelTable()
 {
-	for (int i = 0; i < cabbageWidgets.getNumChildren(); i++) 
-	{
-		const var chanArray = CabbageWidgetData::getProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::channel);
-		const String channelName = (chanArray.size()>0 ? chanArray[0].toString() : chanArray.toString());
-		const var widgetArray = CabbageWidgetData::getProperty(cabbageWidgets.getChild(i),
-			CabbageIdentifierIds::widgetarray);
-
-		StringArray channels;
-
-		if (widgetArray.size() > 0)
-			channels.add(channelName);
-		else if (chanArray.size() == 1)
-			channels.add(channelName);
-		else if (chanArray.size() > 1) {
-			for (int j = 0; j < chanArray.size(); j++)
-				channels.add(var(chanArray[j]));
-		}
+    const ScopedLock sl(channelDataLock);
+    polledChannelValues.clear();
+    stringChannelTable.clear();
+    identChannelTable.clear();
+
+    for (int i = 0; i < cabbageWidgets.getNumChildren(); i++)
+    {
+        ValueTree widget = cabbageWidgets.getChild(i);
+        const var chanArray = CabbageWidgetData::getProperty(widget, CabbageIdentifierIds::channel);
+        const String channelName = (chanArray.size()>0 ? chanArray[0].toString() : chanArray.toString());
+        const var widgetArray = CabbageWidgetData::getProperty(widget, CabbageIdentifierIds::widgetarray);
+
+        StringArray channels;
+
+        if (widgetArray.size() > 0)
+            channels.add(channelName);
+        else if (chanArray.size() == 1)
+            channels.add(channelName);
+        else if (chanArray.size() > 1) {
+            for (int j = 0; j < chanArray.size(); j++)
+                channels.add(var(chanArray[j]));
+        }
+
+        const var value = CabbageWidgetData::getProperty(widget, CabbageIdentifierIds::value);
+        const String identChannel = CabbageWidgetData::getStringProp(widget, CabbageIdentifierIds::identchannel);
+        const String typeOfWidget = CabbageWidgetData::getStringProp(widget, CabbageIdentifierIds::type);
+
+        if (channels.size() == 1 && channels[0].isNotEmpty())
+        {
+            if (value.isString() == false)
+            {
+                polledChannelValues.add(widget, CabbageIdentifierIds::value, channels[0]);
+            }
+            else
+                addStringChannelEntry(stringChannelTable, widget, channels[0]);
+        }
+        //currently only dealing with a max of 2 channels...
+        else if (channels.size() == 2 && channels[0].isNotEmpty() && channels[1].isNotEmpty() &&
+            typeOfWidget != CabbageWidgetTypes::eventsequencer)
+        {
+            if (typeOfWidget == CabbageWidgetTypes::xypad)
+            {
+                polledChannelValues.add(widget, CabbageIdentifierIds::valuex, channels[0]);
+                polledChannelValues.add(widget, CabbageIdentifierIds::valuey, channels[1]);
+            }
+            else if (typeOfWidget.contains("range"))
+            {
+                polledChannelValues.add(widget, CabbageIdentifierIds::minvalue, channels[0]);
+                polledChannelValues.add(widget, CabbageIdentifierIds::maxvalue, channels[1]);
+            }
+        }
 
-		const var value = CabbageWidgetData::getProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::value);
+        if (identChannel.isNotEmpty())
+            addStringChannelEntry(identChannelTable, widget, identChannel);
+    }
 
-		const String identChannel = CabbageWidgetData::getStringProp(cabbageWidgets.getChild(i),
-			CabbageIdentifierIds::identchannel);
+    setPolledChannels(polledChannelValues.getChannelNames());
+}
 
-		const String typeOfWidget = CabbageWidgetData::getStringProp(cabbageWidgets.getChild(i),
-			CabbageIdentifierIds::type);
+//==============================================================================
+// This method is responsible for updating widget valuetrees based on the current
+// data stored in each widget's software channel bus. Numeric channels come from
+// the snapshot taken on the audio thread, so this is a flat diff against the
+// last values seen.
+//==============================================================================
+void CabbagePluginProcessor::getChannelDataFromCsound() 
+{
+	//the tables and scratch space belong to this instance, a second thread has nothing to add
+	const ScopedTryLock sl(channelDataLock);
 
-		const String chann = channels[0];
+	if (sl.isLocked() == false)
+		return;
 
+	if (const MYFLT* values = getPolledChannelValues())
+	{
+		for (int i = 0; i < polledChannelValues.size(); i++)
+			polledChannelValues.set(i, values[i]);
 
-		if (channels.size() == 1 && channels[0].isNotEmpty()) {
+		polledChannelValues.flushToValueTrees();
+	}
 
-			if (value.isString() == false) 
-			{
-				if (getCsound()->GetChannel(channels[0].toUTF8()) != float(value))
-				{
-					CabbageWidgetData::setNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::value,
-						getCsound()->GetChannel(channels[0].toUTF8()));
-				}
+	for (const auto& entry : stringChannelTable)
+	{
+		String text;
+		readStringChannel(entry, text, false);
+		CabbageWidgetData::setProperty(entry.widget, CabbageIdentifierIds::value, text);
+	}
 
+	for (const auto& entry : identChannelTable)
+	{
+		String identifierText;
+		ValueTree widget = entry.widget;
+		const String identChannelMessage = CabbageWidgetData::getStringProp(widget,
+			CabbageIdentifierIds::identchannelmessage);
+
+		//a channel is emptied once it has been handled, unless it holds the widget's
+		//identchannelmessage, so only channels Csound has written to since get parsed
+		if (readStringChannel(entry, identifierText, true, identChannelMessage) == false)
+			continue;
+
+		//CabbageUtilities::debug(identifierText);
+		if (identifierText != identChannelMessage) {
+			CabbageWidgetData::setCustomWidgetState(widget, " " + identifierText);
+
+			if (identifierText.contains("tablenumber")) //update even if table number has not changed
+				CabbageWidgetData::setProperty(widget, CabbageIdentifierIds::update, 1);
+			else if (identifierText == CabbageIdentifierIds::tofront.toString() + "()") {
+				CabbageWidgetData::setProperty(widget, CabbageIdentifierIds::tofront,
+					Random::getSystemRandom().nextInt());
 			}
-			else 
-			{
-				char tmp_str[4096] = { 0 };
-				getCsound()->GetStringChannel(channels[0].toUTF8(), tmp_str);
-				CabbageWidgetData::setProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::value,
-					String(tmp_str));
-			}
-		}
 
-		//currently only dealing with a max of 2 channels...
-		else if (channels.size() == 2 && channels[0].isNotEmpty() && channels[1].isNotEmpty() &&
-			typeOfWidget != CabbageWidgetTypes::eventsequencer) 
-		{
-			const float valuex = CabbageWidgetData::getNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::valuex);
-			const float valuey = CabbageWidgetData::getNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::valuey);
-			if (getCsound()->GetChannel(channels[0].toUTF8()) != valuex
-				|| getCsound()->GetChannel(channels[1].toUTF8()) != valuey) {
-				if (typeOfWidget == CabbageWidgetTypes::xypad) {
-					CabbageWidgetData::setNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::valuex,
-						getCsound()->GetChannel(channels[0].toUTF8()));
-					CabbageWidgetData::setNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::valuey,
-						getCsound()->GetChannel(channels[1].toUTF8()));
-				}
-				else if (typeOfWidget.contains("range")) {
-					const float minValue = CabbageWidgetData::getNumProp(cabbageWidgets.getChild(i),
-						CabbageIdentifierIds::minvalue);
-					const float maxValue = CabbageWidgetData::getNumProp(cabbageWidgets.getChild(i),
-						CabbageIdentifierIds::maxvalue);
-					CabbageWidgetData::setNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::minvalue,
-						getCsound()->GetChannel(channels[0].toUTF8()));
-					CabbageWidgetData::setNumProp(cabbageWidgets.getChild(i), CabbageIdentifierIds::maxvalue,
-						getCsound()->GetChannel(channels[1].toUTF8()));
-				}
-			}
+			CabbageWidgetData::setProperty(widget, CabbageIdentifierIds::update,
+				0); //reset value for further updates
+
 		}
+	}
+}
 
-		if (identChannel.isNotEmpty()) {
-			const String identChannelMessage = CabbageWidgetData::getStringProp(cabbageWidgets.getChild(i),
-				CabbageIdentifierIds::identchannelmessage);
-			memset(&tmp_string[0], 0, sizeof(tmp_string));
-			getCsound()->GetStringChannel(identChannel.toUTF8(), tmp_string);
+bool CabbagePluginProcessor::addStringChannelEntry(Array<StringChannelEntry>& table, ValueTree widget, const String& channel)
+{
+    if (csdCompiledWithoutError() == false)
+        return false;
 
-			const String identifierText(tmp_string);
-			//CabbageUtilities::debug(identifierText);
-			if (identifierText.isNotEmpty() && identifierText != identChannelMessage) {
-				CabbageWidgetData::setCustomWidgetState(cabbageWidgets.getChild(i), " " + identifierText);
+    StringChannelEntry entry { widget, channel, nullptr, nullptr };
 
-				if (identifierText.contains("tablenumber")) //update even if table number has not changed
-					CabbageWidgetData::setProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::update, 1);
-				else if (identifierText == CabbageIdentifierIds::tofront.toString() + "()") {
-					CabbageWidgetData::setProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::tofront,
-						Random::getSystemRandom().nextInt());
-				}
+    if (resolveStringChannel(entry, *getCsound()) == false)
+        return false;
 
-				getCsound()->SetChannel(identChannel.toUTF8(), (char *) "");
+    table.add(entry);
+    return true;
+}
 
-				CabbageWidgetData::setProperty(cabbageWidgets.getChild(i), CabbageIdentifierIds::update,
-					0); //reset value for further updates
+//looks the channel up in a compiled Csound instance, which owns its memory
+bool CabbagePluginProcessor::resolveStringChannel(StringChannelEntry& entry, Csound& target)
+{
+    MYFLT* data = nullptr;
+    entry.data = nullptr;
+    entry.lock = nullptr;
 
-			}
-		}
-	}
+    if (target.GetChannelPtr(data, entry.channel.toUTF8(),
+            CSOUND_STRING_CHANNEL | CSOUND_INPUT_CHANNEL | CSOUND_OUTPUT_CHANNEL) != CSOUND_SUCCESS)
+        return false;
+
+    entry.data = reinterpret_cast<STRINGDAT*>(data);
+    entry.lock = csoundGetChannelLock(target.GetCsound(), entry.channel.toUTF8());
+    return true;
 }
 
-void CabbagePluginProcessor::triggerCsoundEvents() {
-    for (int x = 0; x < matrixEventSequencers.size(); x++) {
-        const ValueTree widgetData = CabbageWidgetData::getValueTreeForComponent(cabbageWidgets,
-                                                                                 matrixEventSequencers[x]->channel,
-                                                                                 true);
-        const String channel = CabbageWidgetData::getStringProp(widgetData, CabbageIdentifierIds::channel);
-        const int position = getCsound()->GetChannel(channel.toUTF8());
-
-        if (CabbageWidgetData::getStringProp(widgetData, CabbageIdentifierIds::orientation) == "vertical") {
-            for (int i = 0; i < CabbageWidgetData::getNumProp(widgetData, CabbageIdentifierIds::matrixcols); i++) {
-                if (matrixEventSequencers[x]->position != position) {
-                    String event = matrixEventSequencers[x]->events.getUnchecked(i)->getReference(position);
-                    if (event.isNotEmpty()) {
-                        getCsound()->InputMessage(event.toUTF8());
-                    }
-                }
-            }
-        } else //horizontal
+// Copies a string channel out under its Csound lock, emptying it if asked to and
+// it doesn't hold unlessEqualTo. Nothing is allocated while the lock is held; if the scratch buffer is too small
+// the lock is dropped, the buffer grown, and the read tried again. Returns false
+// if the channel was empty.
+bool CabbagePluginProcessor::readStringChannel(const StringChannelEntry& entry, String& text, bool emptyChannel, const String& unlessEqualTo)
+{
+    size_t length = 0;
+
+    if (entry.data == nullptr)
+        return false;
+
+    for (;;)
+    {
+        csoundSpinLock(entry.lock);
+
+        if (entry.data->data == nullptr || entry.data->data[0] == 0)
         {
-            for (int i = 0; i < CabbageWidgetData::getNumProp(widgetData, CabbageIdentifierIds::matrixrows); i++) {
-                if (matrixEventSequencers[x]->position != position) {
-                    String event = matrixEventSequencers[x]->events.getUnchecked(position)->getReference(i);
-                    if (event.isNotEmpty()) {
-                        getCsound()->InputMessage(event.toUTF8());
-                    }
-                }
-            }
+            csoundSpinUnLock(entry.lock);
+            return false;
+        }
+
+        length = strlen(entry.data->data);
+
+        if (length < stringChannelScratchSize)
+        {
+            memcpy(stringChannelScratch.get(), entry.data->data, length);
+
+            if (emptyChannel && ((size_t) unlessEqualTo.getNumBytesAsUTF8() != length
+                                 || memcmp(unlessEqualTo.toRawUTF8(), entry.data->data, length) != 0))
+                entry.data->data[0] = 0;
+
+            csoundSpinUnLock(entry.lock);
+            break;
         }
-        matrixEventSequencers[x]->position = position;
+
+        csoundSpinUnLock(entry.lock);
+        stringChannelScratchSize = nextPowerOfTwo(int(length) + 1);
+        stringChannelScratch.malloc(stringChannelScratchSize);
     }
+
+    text = String::fromUTF8(stringChannelScratch.get(), int(length));
+    return true;
 }
 
 //================================================================================
@@ -1076,14 +1342,11 @@ void CabbagePluginProcessor::enableXYAutomator(String name, bool enable, Line<fl
 
 //======================================================================================================
 CabbageAudioParameter *CabbagePluginProcessor::getParameterForXYPad(String name) {
-    for (auto param : getParameters()) {
-        if (CabbageAudioParameter *cabbageParam = dynamic_cast<CabbageAudioParameter *> (param)) {
-            if (name == cabbageParam->getWidgetName())
-                return dynamic_cast<CabbageAudioParameter *> (cabbageParam);
-        }
-    }
+    return getParameterForWidget(name);
+}
 
-    return nullptr;
+CabbageAudioParameter *CabbagePluginProcessor::getParameterForWidget(const String &name) {
+    return parameterIndex[name];
 }
 
 //==============================================================================
@@ -1091,6 +1354,39 @@ void CabbagePluginProcessor::setCabbageParameter(String channel, float value) {
     getCsound()->SetChannel(channel.toUTF8().getAddress(), value);
 }
 
+void CabbagePluginProcessor::releaseChannelPointers()
+{
+    //string channel memory belongs to the Csound instance, resolveChannelPointers() finds it again
+    const ScopedLock sl(channelDataLock);
+
+    for (auto* table : { &stringChannelTable, &identChannelTable })
+        for (auto& entry : *table)
+        {
+            entry.data = nullptr;
+            entry.lock = nullptr;
+        }
+
+    for (auto* param : getParameters())
+        if (CabbageAudioParameter* cabbageParam = dynamic_cast<CabbageAudioParameter*> (param))
+            cabbageParam->releaseChannelPointer();
+}
+
+//target may not be installed yet, automation then goes to it from here on
+void CabbagePluginProcessor::resolveChannelPointers(Csound& target)
+{
+    {
+        const ScopedLock sl(channelDataLock);
+
+        for (auto* table : { &stringChannelTable, &identChannelTable })
+            for (auto& entry : *table)
+                resolveStringChannel(entry, target);
+    }
+
+    for (auto* param : getParameters())
+        if (CabbageAudioParameter* cabbageParam = dynamic_cast<CabbageAudioParameter*> (param))
+            cabbageParam->resolveChannelPointer (&target);
+}
+
 void CabbagePluginProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     bool csoundRecompiled = false;
@@ -1120,6 +1416,8 @@ void CabbagePluginProcessor::prepareToPlay(double sampleRate, int samplesPerBloc
         CsoundPluginProcessor::prepareToPlay(sampleRate, samplesPerBlock);
         initAllCsoundChannels(cabbageWidgets);
     }
+    else
+        selectProcessingMode(samplesPerBlock);
 }
 
 
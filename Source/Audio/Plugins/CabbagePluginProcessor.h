@@ -22,13 +22,16 @@
 
 #include "CsoundPluginProcessor.h"
 #include "../../Widgets/CabbageWidgetData.h"
+#include "../../Widgets/CabbageWidgetValues.h"
+#include "../../Widgets/CabbageWidgetIndex.h"
+#include "../../Utilities/CabbageFileWatcher.h"
 #include "../../CabbageIds.h"
 #include "../../Widgets/CabbageXYPad.h"
 
 class CabbageAudioParameter;
 
 class CabbagePluginProcessor : public CsoundPluginProcessor,
-public Timer
+private CabbageFileWatcher::Listener
 {
 public:
 
@@ -72,10 +75,15 @@ public:
 
     ValueTree cabbageWidgets;
     void getChannelDataFromCsound() override;
-    void triggerCsoundEvents() override;
+    void buildChannelTable();
     void setWidthHeight();
     bool addImportFiles (StringArray& lineFromCsd);
     void parseCsdFile (StringArray& linesFromCsd);
+    void applyFormSettings (ValueTree formWidget);
+    //sets this instance up from the cache and returns the document to compile, or null if there is no valid entry
+    std::shared_ptr<const CsdDocument> restoreFromInstrumentCache (File inputFile);
+    //parsedWidgets defaults to the current tree
+    void addToInstrumentCache (File inputFile, ValueTree parsedWidgets = ValueTree());
     void createParameters();
     void updateWidgets (String csdText);
     void handleXmlImport (XmlElement* xml, StringArray& linesFromCsd);
@@ -91,7 +99,12 @@ public:
     void expandMacroText (String &line, ValueTree wData);
 	void prepareToPlay(double sampleRate, int samplesPerBlock) override;
 	void setCabbageParameter(String channel, float value);
+    void releaseChannelPointers() override;
+    void resolveChannelPointers (Csound& target) override;
     CabbageAudioParameter* getParameterForXYPad (String name);
+    CabbageAudioParameter* getParameterForWidget (const String& name);
+    ValueTree getWidgetForName (const String& name)         { return widgetIndex.getWidgetForName (name); }
+    ValueTree getWidgetForChannel (const String& channel)   { return widgetIndex.getWidgetForChannel (channel); }
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -108,8 +121,10 @@ public:
     StringArray cabbageScriptGeneratedCode;
     Array<PlantImportStruct> plantStructs;
 
-    int64 csdLastModifiedAt;
-    void timerCallback() override;
+    //with autoupdate() in the form line the csd is watched, and edits to it are
+    //compiled in the background and crossfaded in without stopping the audio
+    void reloadCsound();
+    void backgroundCompileFinished (CompiledCsound& compiled) override;
 	//uid needed for Cabbage host
 	AudioProcessorGraph::NodeID nodeId;
 
@@ -125,11 +140,53 @@ public:
 		return csdArray;
 	}
 private:
+    //widget properties that mirror a Csound channel, see buildChannelTable()
+
+    //string and ident channels are read straight from Csound's channel memory. Cabbage
+    //empties an ident channel once it has handled it, unless it holds the widget's
+    //identchannelmessage, so an empty one means no change.
+    //data and lock point into the instance resolveChannelPointers() was last given, null if none compiled
+    struct StringChannelEntry
+    {
+        ValueTree widget;
+        String channel;
+        STRINGDAT* data;
+        int* lock;
+    };
+
+    void watchedFileChanged (const File& file) override;
+    File prepareCsdForCompile (File inputFile);
+    void migrateWidgetValues (ValueTree oldWidgets);
+
+    File sourceCsdFile;
+    CabbageFileWatcher csdFileWatcher { *this };
+    bool reloadPending = false;
+    ValueTree reloadParsedWidgets;
+    //the form settings of a reload that only apply once its instance is swapped in
+    bool parsingReload = false;
+    int reloadRenderAhead = -1;
+
+    CabbageWidgetValues polledChannelValues;
+    CabbageWidgetIndex widgetIndex;
+    HashMap<String, CabbageAudioParameter*> parameterIndex;
+    Array<StringChannelEntry> stringChannelTable, identChannelTable;
+
+    bool addStringChannelEntry (Array<StringChannelEntry>& table, ValueTree widget, const String& channel);
+    static bool resolveStringChannel (StringChannelEntry& entry, Csound& target);
+    bool readStringChannel (const StringChannelEntry& entry, String& text, bool emptyChannel, const String& unlessEqualTo = String());
+
+    //scratch space for the above, owned by each instance and only touched with channelDataLock held
+    CriticalSection channelDataLock;
+    HeapBlock<char> stringChannelScratch;
+    size_t stringChannelScratchSize = 0;
+
     controlChannelInfo_s* csoundChanList;
     int numberOfLinesInPlantCode = 0;
     String pluginName;
     File csdFile;
     int linesToSkip = 0;
+    //the plant files addImportFiles() found, they are part of what the instrument cache is keyed on
+    Array<File> importedFiles;
     NamedValueSet macroText;
     var macroNames;
     var macroStrings;
@@ -166,8 +223,29 @@ public:
 	{
 		//csound.SetChannel (channel.toUTF8(), range.convertFrom0to1 (newValue));
         currentValue = isCombo ? juce::roundToInt(range.convertFrom0to1 (newValue)) : range.convertFrom0to1 (newValue);
-		owner->setCabbageParameter(channel, currentValue);
+		if (MYFLT* channelPtr = channelPointer.load())
+			storeChannelValue (channelPtr, currentValue);
+		else
+			owner->setCabbageParameter(channel, currentValue);
+
+	}
 
+	//looked up once after each compile so that automation doesn't go through
+	//Csound's channel hash table. Falls back to SetChannel() while unresolved.
+	void resolveChannelPointer (Csound* csound)
+	{
+		MYFLT* channelPtr = nullptr;
+
+		if (csound == nullptr || csound->GetChannelPtr (channelPtr, channel.toUTF8(),
+			CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL) != 0)
+			channelPtr = nullptr;
+
+		channelPointer.store (channelPtr);
+	}
+
+	void releaseChannelPointer()
+	{
+		channelPointer.store (nullptr);
 	}
 
 	const String getWidgetName() { return widgetName; }
@@ -178,6 +256,21 @@ public:
     bool isCombo = false;
 
 	CabbagePluginProcessor* owner;
+
+private:
+	static void storeChannelValue (MYFLT* channelPtr, MYFLT value)
+	{
+#if JUCE_MSVC
+		static_assert (sizeof (MYFLT) == sizeof (__int64), "expecting a 64 bit MYFLT");
+		union { MYFLT f; __int64 i; } bits;
+		bits.f = value;
+		_InterlockedExchange64 ((volatile __int64*) channelPtr, bits.i);
+#else
+		__atomic_store (channelPtr, &value, __ATOMIC_RELEASE);
+#endif
+	}
+
+	std::atomic<MYFLT*> channelPointer { nullptr };
 };
 
 
@@ -0,0 +1,96 @@
+/*
+  Copyright (C) 2016 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGESNAPSHOTBUFFER_H_INCLUDED
+#define CABBAGESNAPSHOTBUFFER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Single producer, single consumer triple buffer. The producer (usually the audio
+// thread) fills getWriteBuffer() and calls publish(), the consumer calls acquire()
+// and, if it returns true, reads the newest complete snapshot from getReadBuffer().
+// Neither side ever blocks or allocates, and the consumer never sees a half
+// written snapshot. setSize() allocates and must not run while either side is in use.
+//==============================================================================
+template <typename ElementType>
+class CabbageSnapshotBuffer
+{
+public:
+    CabbageSnapshotBuffer() {}
+    ~CabbageSnapshotBuffer() {}
+
+    void setSize (int numElementsPerSnapshot)
+    {
+        numElements = jmax (0, numElementsPerSnapshot);
+        data.calloc (size_t (numElements) * 3);
+        frontIndex = 0;
+        backIndex = 2;
+        state = 1;
+    }
+
+    int getSize() const
+    {
+        return numElements;
+    }
+
+    //==============================================================================
+    // producer side
+    ElementType* getWriteBuffer()
+    {
+        return data.getData() + backIndex * numElements;
+    }
+
+    void publish()
+    {
+        backIndex = state.exchange (backIndex | freshFlag) & indexMask;
+    }
+
+    //==============================================================================
+    // consumer side, returns false if nothing new has been published since the last call
+    bool acquire()
+    {
+        if ((state.load() & freshFlag) == 0)
+            return false;
+
+        frontIndex = state.exchange (frontIndex) & indexMask;
+        return true;
+    }
+
+    const ElementType* getReadBuffer() const
+    {
+        return data.getData() + frontIndex * numElements;
+    }
+
+private:
+    enum
+    {
+        indexMask = 3,
+        freshFlag = 4
+    };
+
+    HeapBlock<ElementType> data;
+    int numElements = 0;
+    int frontIndex = 0, backIndex = 2;
+    std::atomic<int> state { 1 };
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageSnapshotBuffer)
+};
+
+#endif  // CABBAGESNAPSHOTBUFFER_H_INCLUDED
@@ -22,7 +22,6 @@
 #include "../../Utilities/CabbageUtilities.h"
 #include "../../Widgets/CabbageWidgetData.h"
 
-
 //==============================================================================
 CsoundPluginProcessor::CsoundPluginProcessor (File csdFile, const int ins, const int outs, bool debugMode)
     : AudioProcessor (BusesProperties()
@@ -35,6 +34,7 @@ CsoundPluginProcessor::CsoundPluginProcessor (File csdFile, const int ins, const
                                         ),
       csdFile (csdFile)
 {
+    hostPositionSnapshot.setSize (1);
 
     //this->getBusesLayout().inputBuses.add(AudioChannelSet::discreteChannels(17));
 
@@ -44,6 +44,7 @@ CsoundPluginProcessor::CsoundPluginProcessor (File csdFile, const int ins, const
 
 CsoundPluginProcessor::~CsoundPluginProcessor()
 {
+    stopRenderAhead();
 	resetCsound();
 }
 
@@ -66,104 +67,329 @@ void CsoundPluginProcessor::resetCsound()
 
 //==============================================================================
 //==============================================================================
-bool CsoundPluginProcessor::setupAndCompileCsound(File currentCsdFile, File filePath, int sr, bool isMono, bool debugMode)
-{
-    
-    csdFile = currentCsdFile;
-    CabbageUtilities::debug(csdFile.getFullPathName());
-    
-	csound.reset (new Csound());
-	csdFilePath = filePath;
-	csdFilePath.setAsCurrentWorkingDirectory();
-	csound->SetHostImplementedMIDIIO(true);
-	csound->SetHostImplementedAudioIO(1, 0);
-	csound->SetHostData(this);
-
-	csound->CreateMessageBuffer(0);
-	csound->SetExternalMidiInOpenCallback(OpenMidiInputDevice);
-	csound->SetExternalMidiReadCallback(ReadMidiData);
-	csound->SetExternalMidiOutOpenCallback(OpenMidiOutputDevice);
-	csound->SetExternalMidiWriteCallback(WriteMidiData);
-	csoundParams = nullptr;
-	csoundParams.reset (new CSOUND_PARAMS());
-
-	csoundParams->displays = 0;
-
-	csound->SetIsGraphable(true);
-	csound->SetMakeGraphCallback(makeGraphCallback);
-	csound->SetDrawGraphCallback(drawGraphCallback);
-	csound->SetKillGraphCallback(killGraphCallback);
-	csound->SetExitGraphCallback(exitGraphCallback);
-
-
-	csound->SetOption((char*)"-n");
-	csound->SetOption((char*)"-d");
-	csound->SetOption((char*)"-b0");
+bool CsoundPluginProcessor::setupAndCompileCsound(File currentCsdFile, File filePath, int sr, bool isMono, bool debugMode, bool compileFromMemory)
+{
+    //the old instance is let go of first so that any ports or devices it holds are free again
+    CompiledCsound compiled;
+    installCsound (compiled);
+
+    compileCsoundInstance (compiled, currentCsdFile, filePath, sr, isMono, debugMode, compileFromMemory);
+    installCsound (compiled);
+
+    if (csdCompiledWithoutError() == false)
+		CabbageUtilities::debug("Csound could not compile your file?");
+
+    return csdCompiledWithoutError();
+}
+
+bool CsoundPluginProcessor::setupAndCompileCsound(std::shared_ptr<const CsdDocument> document, File currentCsdFile, File filePath, int sr, bool isMono)
+{
+    CompiledCsound compiled;
+    installCsound (compiled);
+
+    compiled.document = document;
+    compileCsoundInstance (compiled, currentCsdFile, filePath, sr, isMono, false, true);
+    installCsound (compiled);
+
+    if (csdCompiledWithoutError() == false)
+		CabbageUtilities::debug("Csound could not compile your file?");
+
+    return csdCompiledWithoutError();
+}
+
+//==============================================================================
+// Builds, compiles and starts a new Csound instance without touching any of the
+// state the running instance or the audio thread use, so it is safe to call from
+// a background thread while the current instance keeps playing.
+//==============================================================================
+void CsoundPluginProcessor::compileCsoundInstance (CompiledCsound& compiled, File currentCsdFile, File filePath, int sr, bool isMono, bool debugMode, bool compileFromMemory)
+{
+    CabbageUtilities::debug(currentCsdFile.getFullPathName());
+
+    compiled.csdFile = currentCsdFile;
+    compiled.filePath = filePath;
+	compiled.csound.reset (new Csound());
+	Csound& newCsound = *compiled.csound;
+
+	newCsound.SetHostImplementedMIDIIO(true);
+	newCsound.SetHostImplementedAudioIO(1, 0);
+	newCsound.SetHostData(this);
+
+	newCsound.CreateMessageBuffer(0);
+	newCsound.SetExternalMidiInOpenCallback(OpenMidiInputDevice);
+	newCsound.SetExternalMidiReadCallback(ReadMidiData);
+	newCsound.SetExternalMidiOutOpenCallback(OpenMidiOutputDevice);
+	newCsound.SetExternalMidiWriteCallback(WriteMidiData);
+	compiled.params.reset (new CSOUND_PARAMS());
+
+	compiled.params->displays = 0;
+
+	newCsound.SetIsGraphable(true);
+	newCsound.SetMakeGraphCallback(makeGraphCallback);
+	newCsound.SetDrawGraphCallback(drawGraphCallback);
+	newCsound.SetKillGraphCallback(killGraphCallback);
+	newCsound.SetExitGraphCallback(exitGraphCallback);
+
+
+	newCsound.SetOption((char*)"-n");
+	newCsound.SetOption((char*)"-d");
+	newCsound.SetOption((char*)"-b0");
+
+    //relative #include, GEN01 and soundfile paths are found from the csd's folder. The
+    //working directory is process wide and instances compile on several threads at
+    //once, so it is never changed here. SetOption() takes the whole string as one
+    //argument, the same as the --omacro options, so paths with spaces are fine
+    for (auto variable : { "SSDIR", "SFDIR", "SADIR", "INCDIR" })
+        newCsound.SetOption (const_cast<char*> (("--env:" + String (variable) + "+=" + filePath.getFullPathName()).toRawUTF8()));
     
-    addMacros(csdFile.loadFileAsString());
+    if (compiled.document == nullptr)
+        compiled.document = CsdDocument::load (currentCsdFile);
+
+    compiled.fromMemory = compileFromMemory;
+    addMacros (*compiled.document, newCsound);
 
 	if (debugMode)
 	{
-		csoundDebuggerInit(csound->GetCsound());
-		csoundSetBreakpointCallback(csound->GetCsound(), breakpointCallback, (void*)this);
-		csoundSetInstrumentBreakpoint(csound->GetCsound(), 1, 413);
-		csoundParams->ksmps_override = 4410;
+		csoundDebuggerInit(newCsound.GetCsound());
+		csoundSetBreakpointCallback(newCsound.GetCsound(), breakpointCallback, (void*)this);
+		csoundSetInstrumentBreakpoint(newCsound.GetCsound(), 1, 413);
+		compiled.params->ksmps_override = 4410;
 	}
 
-	//instrument must at least be stereo
-    if(isMono)
-    {
-        csoundParams->nchnls_override = 1;
-        numCsoundChannels = 1;
-    }
-    else
-    {
-        CabbageUtilities::debug(csdFile.loadFileAsString());
-        numCsoundChannels = CabbageUtilities::getHeaderInfo(csdFile.loadFileAsString(), "nchnls");
-        csoundParams->nchnls_override = numCsoundChannels;
-    }
+	//instrument must at least be stereo
+    if(isMono)
+    {
+        compiled.params->nchnls_override = 1;
+        compiled.numChannels = 1;
+    }
+    else
+    {
+        compiled.numChannels = compiled.document->getNumChannels();
+        compiled.params->nchnls_override = compiled.numChannels;
+    }
     
-	const int requestedSampleRate = CabbageUtilities::getHeaderInfo(csdFile.loadFileAsString(), "sr");
-	const int requestedKsmpsRate = CabbageUtilities::getHeaderInfo(csdFile.loadFileAsString(), "ksmps");
+	const int requestedSampleRate = compiled.document->getHeaderValue("sr");
+	const int requestedKsmpsRate = compiled.document->getHeaderValue("ksmps");
 	
 	if (requestedKsmpsRate == -1)
-		csoundParams->ksmps_override = 32;
+		compiled.params->ksmps_override = 32;
 
-	csoundParams->sample_rate_override = requestedSampleRate>0 ? requestedSampleRate : sr;
+	compiled.params->sample_rate_override = requestedSampleRate>0 ? requestedSampleRate : sr;
 
-	csound->SetParams(csoundParams.get());
+	newCsound.SetParams(compiled.params.get());
+
+	if (compiled.document->hasCsoundSection())
+	{
+		//the text is already in memory, no need for Csound to go back to disk for it
+		if (compileFromMemory)
+		{
+			compiled.compileResult = newCsound.CompileCsdText (const_cast<char*> (compiled.document->getText().toUTF8().getAddress()));
 
-	if (csdFile.loadFileAsString().contains("<Csound") || csdFile.loadFileAsString().contains("</Csound"))
-		compileCsdFile(csdFile);
+			if (compiled.compileResult == 0)
+				compiled.compileResult = newCsound.Start();
+		}
+		else
+			compiled.compileResult = newCsound.Compile (const_cast<char*> (currentCsdFile.getFullPathName().toUTF8().getAddress()));
+	}
 	else
 	{
 #ifdef CabbagePro
-		compileCsdString(Encrypt::decode(csdFile));
-		csound->Start();
+		compiled.compileResult = newCsound.CompileCsdText (const_cast<char*> (Encrypt::decode(currentCsdFile).toUTF8().getAddress()));
+		newCsound.Start();
 #endif
+	}
 }
 
+//==============================================================================
+// Swaps a compiled instance in for the current one. Everything the audio thread
+// needs from the new instance is looked up first, the swap lock is only held to
+// hand the pointers over between host blocks. processBlock() outputs silence if
+// it runs into that. With crossfade set the old instance is kept performing for
+// a short fade out rather than being cut off, and is deleted on the message
+// thread once the fade is over.
+//==============================================================================
+void CsoundPluginProcessor::installCsound (CompiledCsound& compiled, bool crossfade)
+{
+    std::unique_ptr<Csound> oldCsound, oldRetiringCsound;
+    const bool compiledWithoutError = (compiled.csound != nullptr && compiled.compileResult == 0);
 
-	if (csdCompiledWithoutError())
-	{
-		csdKsmps = csound->GetKsmps();
-		CSspout = csound->GetSpout();
-		CSspin = csound->GetSpin();
-		cs_scale = csound->Get0dBFS();
-		csndIndex = csound->GetKsmps();
+    //the render thread performs the current instance, and processBlock() keeps going while it stops
+    stopRenderAhead();
 
-		this->setLatencySamples(csound->GetKsmps());
-	}
-	else
-		CabbageUtilities::debug("Csound could not compile your file?");
+    if (compiled.renderAhead >= 0)
+        renderAheadRequested = compiled.renderAhead;
 
-    return csdCompiledWithoutError();
+    //the old channel pointers die with the old Csound instance
+    MYFLT* newHostChannelPointers[numHostChannels] = {};
+    Array<MYFLT*> newPolledChannelPointers, newPositionChannels;
+    StringArray channelNames;
+    int newKsmps = 0;
+    MYFLT* newSpin = nullptr, *newSpout = nullptr;
+    MYFLT newScale = 1;
+
+    {
+        const SpinLock::ScopedLockType lock (polledChannelLock);
+        channelNames = polledChannelNames;
+    }
+
+    if (compiledWithoutError)
+    {
+        Csound& newCsound = *compiled.csound;
+        newKsmps = newCsound.GetKsmps();
+        newSpin = newCsound.GetSpin();
+        newSpout = newCsound.GetSpout();
+        newScale = newCsound.Get0dBFS();
+
+        resolveHostChannels (newCsound, newHostChannelPointers);
+        resolvePolledChannels (newCsound, channelNames, newPolledChannelPointers);
+
+        {
+            const ScopedLock lock (matrixEventSequencerLock);
+
+            for (auto* matrix : matrixEventSequencers)
+                newPositionChannels.add (matrix->findPositionChannel (newCsound));
+        }
+
+        resolveChannelPointers (newCsound);
+    }
+    else
+        releaseChannelPointers();
+
+    //the fade is done in processBlock(), which doesn't perform Csound in render ahead mode
+    const int fadeLength = (renderAheadRequested > 0 ? 0 : int (samplingRate * crossfadeSeconds));
+    const bool fadeOut = (crossfade && csound != nullptr && csdCompiledWithoutError() && fadeLength > 0);
+    AudioSampleBuffer newCrossfadeBuffer;
+
+    if (fadeOut)
+        newCrossfadeBuffer.setSize (jmax (getTotalNumInputChannels(), getTotalNumOutputChannels()), jmax (hostBlockSize, 512));
+
+    {
+        const ScopedLock swapLock (csoundSwapLock);
+
+        std::copy (newHostChannelPointers, newHostChannelPointers + numHostChannels, hostChannelPointers);
+
+        //makes sure everything is pushed on the first k-cycle
+        std::fill (hostChannelValues, hostChannelValues + numHostChannels, std::numeric_limits<MYFLT>::quiet_NaN());
 
+        {
+            const SpinLock::ScopedLockType lock (polledChannelLock);
+            polledChannelPointers.swapWith (newPolledChannelPointers);
+        }
+
+        {
+            const ScopedLock lock (matrixEventSequencerLock);
+
+            for (int i = 0; i < matrixEventSequencers.size(); ++i)
+                matrixEventSequencers.getUnchecked (i)->setPositionChannel (newPositionChannels[i]);
+        }
+
+        //a reload that lands mid fade cuts the older instance off
+        oldRetiringCsound = std::move (retiringCsound.csound);
+        retiringCsoundState = retiringNone;
+
+        if (fadeOut)
+        {
+            retiringCsound.csound = std::move (csound);
+            retiringCsound.spin = CSspin;
+            retiringCsound.spout = CSspout;
+            retiringCsound.scale = cs_scale;
+            retiringCsound.ksmps = csdKsmps;
+            retiringCsound.numChannels = numCsoundChannels;
+            retiringCsound.index = csndIndex;
+            retiringCsound.fadeLength = fadeLength;
+            retiringCsound.fadeSamplesLeft = fadeLength;
+            std::swap (crossfadeBuffer, newCrossfadeBuffer);
+            retiringCsoundState = retiringFading;
+        }
+        else
+            oldCsound = std::move (csound);
+
+        csound = std::move (compiled.csound);
+        csoundParams = std::move (compiled.params);
+        csdDocument = compiled.document;
+        csdCompiledFromMemory = compiled.fromMemory;
+        numCsoundChannels = compiled.numChannels;
+        csCompileResult = compiled.compileResult;
+        csdFile = compiled.csdFile;
+        csdFilePath = compiled.filePath;
+
+        if (compiledWithoutError)
+        {
+            csdKsmps = newKsmps;
+            CSspout = newSpout;
+            CSspin = newSpin;
+            cs_scale = newScale;
+            csndIndex = newKsmps;
+            alignedProcessing = (hostBlockSize > 0 && hostBlockSize % csdKsmps == 0);
+        }
+    }
+
+    //windids belong to the instance that registered them. A hot reload's instance has
+    //already registered its displays, into the pending map, in its first k-cycle
+    {
+        const CriticalSection::ScopedLockType lock (signalArrays.getLock());
+
+        if (csound != nullptr && csound->GetCsound() == pendingSignalDisplayCsound)
+            signalDisplaysByWindow.swapWith (pendingSignalDisplaysByWindow);
+        else
+            signalDisplaysByWindow.clear();
+
+        pendingSignalDisplaysByWindow.clear();
+        pendingSignalDisplayCsound = nullptr;
+    }
+
+    if (csdCompiledWithoutError())
+        applyRenderAhead();
+
+    //old instances, and the pointers into them, are let go of here, after the audio thread
+}
+
+//==============================================================================
+void CsoundPluginProcessor::compileCsoundInBackground (File currentCsdFile, File filePath, int sr)
+{
+    backgroundCompileInProgress = true;
+    const bool isMono = isLogicAndMono;
+
+    if (backgroundCompilePool == nullptr)
+        backgroundCompilePool.reset (new ThreadPool (1));
+
+    backgroundCompilePool->addJob ([this, currentCsdFile, filePath, sr, isMono]()
+    {
+        std::unique_ptr<CompiledCsound> compiled (new CompiledCsound());
+        compileCsoundInstance (*compiled, currentCsdFile, filePath, sr, isMono, false, false);
+
+        {
+            const ScopedLock sl (backgroundCompileLock);
+            backgroundCompileResult = std::move (compiled);
+        }
+
+        triggerAsyncUpdate();
+    });
+}
+
+void CsoundPluginProcessor::backgroundCompileFinished (CompiledCsound& compiled)
+{
+    if (compiled.compileResult == 0)
+        installCsound (compiled, true);
+    else
+        CabbageUtilities::debug("Csound could not compile your file, the previous version keeps running");
 }
 
 
 void CsoundPluginProcessor::createFileLogger (File csdFile)
 {
+    //the logger is process wide, so it is only swapped on the message thread
+    if (! MessageManager::existsAndIsCurrentThread())
+    {
+        {
+            const ScopedLock sl (backgroundCompileLock);
+            pendingLoggerFile = csdFile;
+        }
+
+        triggerAsyncUpdate();
+        return;
+    }
+
     String logFileName = csdFile.getParentDirectory().getFullPathName() + String ("/") + csdFile.getFileNameWithoutExtension() + String ("_Log.txt");
     fileLogger.reset (new FileLogger (File (logFileName), String ("Cabbage Log..")));
     Logger::setCurrentLogger (fileLogger.get());
@@ -171,6 +397,25 @@ void CsoundPluginProcessor::createFileLogger (File csdFile)
 //==============================================================================
 void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
 {
+    initCsoundChannels (cabbageData, *csound, csdFilePath);
+}
+
+void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData, CompiledCsound& compiled)
+{
+    initCsoundChannels (cabbageData, *compiled.csound, compiled.filePath);
+}
+
+//target is normally the running instance, a hot reload sets up the new one before it is swapped in
+void CsoundPluginProcessor::initCsoundChannels (ValueTree cabbageData, Csound& target, const File& filePath)
+{
+    //the new instance's displays are kept apart from the running one's until installCsound()
+    if (&target != csound.get())
+    {
+        const CriticalSection::ScopedLockType lock (signalArrays.getLock());
+        pendingSignalDisplaysByWindow.clear();
+        pendingSignalDisplayCsound = target.GetCsound();
+    }
+
     for (int i = 0; i < cabbageData.getNumChildren(); i++)
     {
         const String typeOfWidget = CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::type);
@@ -179,13 +424,13 @@ void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
         {
             if (typeOfWidget == CabbageWidgetTypes::filebutton)
             {
-                csound->SetStringChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
+                target.SetStringChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
                                           CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::file).toUTF8().getAddress());
             }
 
             else
             {
-                csound->SetStringChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
+                target.SetStringChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
                                           CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::text).toUTF8().getAddress());
             }
 
@@ -195,9 +440,9 @@ void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
         {
             if (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::type) == CabbageWidgetTypes::xypad)
             {
-                csound->SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::xchannel).getCharPointer(),
+                target.SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::xchannel).getCharPointer(),
                                     CabbageWidgetData::getNumProp (cabbageData.getChild (i), CabbageIdentifierIds::valuex));
-                csound->SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::ychannel).getCharPointer(),
+                target.SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::ychannel).getCharPointer(),
                                     CabbageWidgetData::getNumProp (cabbageData.getChild (i), CabbageIdentifierIds::valuey));
             }
             else if (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::type) == CabbageWidgetTypes::hrange
@@ -207,10 +452,10 @@ void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
                 if(channels.size()==2)
                 {
                     const var minValue = CabbageWidgetData::getProperty (cabbageData.getChild (i), CabbageIdentifierIds::minvalue);
-                    csound->SetChannel (channels[0].toString().getCharPointer(), float (minValue));
+                    target.SetChannel (channels[0].toString().getCharPointer(), float (minValue));
 
                     const var maxValue = CabbageWidgetData::getProperty (cabbageData.getChild (i), CabbageIdentifierIds::maxvalue);
-                    csound->SetChannel (channels[0].toString().getCharPointer(), float (maxValue));
+                    target.SetChannel (channels[0].toString().getCharPointer(), float (maxValue));
                 }
 
             }
@@ -222,7 +467,7 @@ void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
             else
             {
                 const var value = CabbageWidgetData::getProperty (cabbageData.getChild (i), CabbageIdentifierIds::value);
-                csound->SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
+                target.SetChannel (CabbageWidgetData::getStringProp (cabbageData.getChild (i), CabbageIdentifierIds::channel).getCharPointer(),
                                     float (value));
             }
 
@@ -230,106 +475,162 @@ void CsoundPluginProcessor::initAllCsoundChannels (ValueTree cabbageData)
 
     }
 
-    char path[8192] = {0};
-
     if (CabbageUtilities::getTargetPlatform() == CabbageUtilities::TargetPlatformTypes::Win32)
     {
-        csound->SetChannel ("CSD_PATH", csdFilePath.getParentDirectory().getFullPathName().replace ("\\", "\\\\").toUTF8().getAddress());
+        target.SetChannel ("CSD_PATH", filePath.getParentDirectory().getFullPathName().replace ("\\", "\\\\").toUTF8().getAddress());
     }
     else
     {
-        csound->SetChannel ("CSD_PATH", csdFilePath.getFullPathName().toUTF8().getAddress());
+        target.SetChannel ("CSD_PATH", filePath.getFullPathName().toUTF8().getAddress());
     }
 
-    csound->SetStringChannel ("LAST_FILE_DROPPED", const_cast<char*> (""));
-
-    csdFilePath.setAsCurrentWorkingDirectory();
+    target.SetStringChannel ("LAST_FILE_DROPPED", const_cast<char*> (""));
 
 	if(SystemStats::getOperatingSystemType() == SystemStats::OperatingSystemType::Linux)
     {
-		csound->SetChannel ("LINUX", 1.0);
-        csound->SetChannel ("Linux", 1.0);
+		target.SetChannel ("LINUX", 1.0);
+        target.SetChannel ("Linux", 1.0);
     }
 	if(SystemStats::getOperatingSystemType() == SystemStats::OperatingSystemType::MacOSX)
     {
-		csound->SetChannel ("MAC", 1.0);
-        csound->SetChannel ("Macos", 1.0);
-        csound->SetChannel ("MACOS", 1.0);
+		target.SetChannel ("MAC", 1.0);
+        target.SetChannel ("Macos", 1.0);
+        target.SetChannel ("MACOS", 1.0);
     }
 	if(SystemStats::getOperatingSystemType() == SystemStats::OperatingSystemType::Windows)
     {
-		csound->SetChannel ("Windows", 1.0);
-        csound->SetChannel ("WINDOWS", 1.0);
+		target.SetChannel ("Windows", 1.0);
+        target.SetChannel ("WINDOWS", 1.0);
     }
 
 #if !defined(Cabbage_IDE_Build)
     PluginHostType pluginType;
     if (pluginType.isFruityLoops())
-        csound->SetChannel ("FLStudio", 1.0);
+        target.SetChannel ("FLStudio", 1.0);
     else if (pluginType.isAbletonLive())
-        csound->SetChannel ("AbletonLive", 1.0);
+        target.SetChannel ("AbletonLive", 1.0);
     else if (pluginType.isLogic())
-        csound->SetChannel ("Logic", 1.0);
+        target.SetChannel ("Logic", 1.0);
     else if (pluginType.isArdour())
-        csound->SetChannel ("Ardour", 1.0);
+        target.SetChannel ("Ardour", 1.0);
     else if (pluginType.isCubase())
-        csound->SetChannel ("Cubase", 1.0);
+        target.SetChannel ("Cubase", 1.0);
     else if (pluginType.isSonar())
-        csound->SetChannel ("Sonar", 1.0);
+        target.SetChannel ("Sonar", 1.0);
     else if (pluginType.isNuendo())
-        csound->SetChannel ("Neuendo", 1.0);
+        target.SetChannel ("Neuendo", 1.0);
     else if (pluginType.isReaper())
-        csound->SetChannel ("Reaper", 1.0);
+        target.SetChannel ("Reaper", 1.0);
     else if (pluginType.isRenoise())
-        csound->SetChannel ("Renoise", 1.0);
+        target.SetChannel ("Renoise", 1.0);
     else if (pluginType.isWavelab())
-        csound->SetChannel ("Wavelab", 1.0);
+        target.SetChannel ("Wavelab", 1.0);
     else if (pluginType.isMainStage())
-        csound->SetChannel ("Mainstage", 1.0);
+        target.SetChannel ("Mainstage", 1.0);
     else if (pluginType.isGarageBand())
-        csound->SetChannel ("Garageband", 1.0);
+        target.SetChannel ("Garageband", 1.0);
     else if (pluginType.isSamplitude())
-        csound->SetChannel ("Samplitude", 1.0);
+        target.SetChannel ("Samplitude", 1.0);
     else if (pluginType.isStudioOne())
-        csound->SetChannel ("StudioOne", 1.0);
+        target.SetChannel ("StudioOne", 1.0);
     else if (pluginType.isBitwigStudio())
-        csound->SetChannel ("Bitwig", 1.0);
+        target.SetChannel ("Bitwig", 1.0);
     else if (pluginType.isTracktion())
-        csound->SetChannel ("Tracktion", 1.0);
+        target.SetChannel ("Tracktion", 1.0);
     else if (pluginType.isAdobeAudition())
-        csound->SetChannel ("AdobeAudition", 1.0);
+        target.SetChannel ("AdobeAudition", 1.0);
 #endif
              
     if (CabbageUtilities::getTarget() != CabbageUtilities::TargetTypes::IDE)
     {
-        csound->SetChannel ("IS_A_PLUGIN", 1.0);
+        target.SetChannel ("IS_A_PLUGIN", 1.0);
 
-        if (getPlayHead() != 0 && getPlayHead()->getCurrentPosition (hostInfo))
+        //the play head can only be asked on the audio thread, this is the last position it gave
+        if (hostPositionSnapshot.acquire())
+            hasHostPositionSnapshot = true;
+
+        if (hasHostPositionSnapshot)
         {
-            csound->SetChannel (CabbageIdentifierIds::hostbpm.toUTF8(), hostInfo.bpm);
-            csound->SetChannel (CabbageIdentifierIds::timeinseconds.toUTF8(), hostInfo.timeInSeconds);
-            csound->SetChannel (CabbageIdentifierIds::isplaying.toUTF8(), hostInfo.isPlaying);
-            csound->SetChannel (CabbageIdentifierIds::isrecording.toUTF8(), hostInfo.isRecording);
-            csound->SetChannel (CabbageIdentifierIds::hostppqpos.toUTF8(), hostInfo.ppqPosition);
-            csound->SetChannel (CabbageIdentifierIds::timeinsamples.toUTF8(), hostInfo.timeInSamples);
-            csound->SetChannel (CabbageIdentifierIds::timeSigDenom.toUTF8(), hostInfo.timeSigDenominator);
-            csound->SetChannel (CabbageIdentifierIds::timeSigNum.toUTF8(), hostInfo.timeSigNumerator);
+            const AudioPlayHead::CurrentPositionInfo& position = *hostPositionSnapshot.getReadBuffer();
+            target.SetChannel (CabbageIdentifierIds::hostbpm.toUTF8(), position.bpm);
+            target.SetChannel (CabbageIdentifierIds::timeinseconds.toUTF8(), position.timeInSeconds);
+            target.SetChannel (CabbageIdentifierIds::isplaying.toUTF8(), position.isPlaying);
+            target.SetChannel (CabbageIdentifierIds::isrecording.toUTF8(), position.isRecording);
+            target.SetChannel (CabbageIdentifierIds::hostppqpos.toUTF8(), position.ppqPosition);
+            target.SetChannel (CabbageIdentifierIds::timeinsamples.toUTF8(), position.timeInSamples);
+            target.SetChannel (CabbageIdentifierIds::timeSigDenom.toUTF8(), position.timeSigDenominator);
+            target.SetChannel (CabbageIdentifierIds::timeSigNum.toUTF8(), position.timeSigNumerator);
         }
     }
     else
-        csound->SetChannel ("IS_A_PLUGIN", 0.0);
+        target.SetChannel ("IS_A_PLUGIN", 0.0);
+
+    target.PerformKsmps();
+
+
+}
+//==============================================================================
+void CsoundPluginProcessor::setPolledChannels (const StringArray& channelNames)
+{
+    Array<MYFLT*> channelPointers;
+
+    if (csound != nullptr && csdCompiledWithoutError())
+        resolvePolledChannels (*csound, channelNames, channelPointers);
+
+    const SpinLock::ScopedLockType lock (polledChannelLock);
+    polledChannelNames = channelNames;
+    polledChannelPointers.swapWith (channelPointers);
+    polledChannelSnapshot.setSize (polledChannelNames.size());
+}
+
+//done without any locks held, the pointers are handed over afterwards
+void CsoundPluginProcessor::resolvePolledChannels (Csound& target, const StringArray& channelNames, Array<MYFLT*>& channelPointers)
+{
+    channelPointers.clearQuick();
+
+    for (const auto& channelName : channelNames)
+    {
+        MYFLT* channelPtr = nullptr;
+
+        if (target.GetChannelPtr (channelPtr, channelName.toUTF8(), CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL | CSOUND_OUTPUT_CHANNEL) != 0)
+            channelPtr = nullptr;
+
+        channelPointers.add (channelPtr);
+    }
+}
+
+void CsoundPluginProcessor::updatePolledChannelSnapshot()
+{
+    //never wait on the message thread, if the table is being rebuilt just skip this update
+    const GenericScopedTryLock<SpinLock> lock (polledChannelLock);
 
-    csound->PerformKsmps();
+    if (lock.isLocked() == false || polledChannelPointers.isEmpty())
+        return;
 
+    MYFLT* values = polledChannelSnapshot.getWriteBuffer();
 
+    for (int i = 0; i < polledChannelPointers.size(); i++)
+    {
+        const MYFLT* channelPtr = polledChannelPointers.getUnchecked (i);
+        values[i] = (channelPtr != nullptr ? *channelPtr : std::numeric_limits<MYFLT>::quiet_NaN());
+    }
+
+    polledChannelSnapshot.publish();
+}
+
+const MYFLT* CsoundPluginProcessor::getPolledChannelValues()
+{
+    if (polledChannelSnapshot.getSize() == 0 || polledChannelSnapshot.acquire() == false)
+        return nullptr;
+
+    return polledChannelSnapshot.getReadBuffer();
 }
+
 //==============================================================================
-void CsoundPluginProcessor::addMacros (String csdText)
+void CsoundPluginProcessor::addMacros (const CsdDocument& document, Csound& target)
 {
-    StringArray csdArray;
     String macroName, macroText;
 
-    csdArray.addLines (csdText);
 //
 //    String width = "--macro:SCREEN_WIDTH="+String(screenWidth);
 //    String height = "--macro:SCREEN_HEIGHT="+String(screenHeight);
@@ -338,62 +639,54 @@ void CsoundPluginProcessor::addMacros (String csdText)
     
 
 
-    for (int i = 0; i < csdArray.size(); i++)
+    for (const auto& line : document.getMacroDefinitions())
     {
-
-        if (csdArray[i].trim().substring (0, 7) == "#define")
-        {
-			StringArray tokens;
-//            CabbageUtilities::debug(csdArray[i]);
-            tokens.addTokens (csdArray[i].replace ("#", "").trim() , " ");
-//            CabbageUtilities::debug(tokens[0]);
-            macroName = tokens[1];
-            tokens.remove (0);
-            tokens.remove (0);
-            macroText = "\"" + tokens.joinIntoString (" ").replace (" ", "\ ").replace("\"", "\\\"")+"\"";
-            macroText = tokens.joinIntoString(" ");
-            String fullMacro = "--omacro:" + macroName + "=" + macroText;// + "\"";
-            csound->SetOption (fullMacro.toUTF8().getAddress());
-        }
-
-        if (csdArray[i].contains ("</Cabbage>"))
-            i = csdArray.size();
+		StringArray tokens;
+//        CabbageUtilities::debug(line);
+        tokens.addTokens (line.replace ("#", "").trim() , " ");
+//        CabbageUtilities::debug(tokens[0]);
+        macroName = tokens[1];
+        tokens.remove (0);
+        tokens.remove (0);
+        macroText = "\"" + tokens.joinIntoString (" ").replace (" ", "\ ").replace("\"", "\\\"")+"\"";
+        macroText = tokens.joinIntoString(" ");
+        String fullMacro = "--omacro:" + macroName + "=" + macroText;// + "\"";
+        target.SetOption (fullMacro.toUTF8().getAddress());
     }
 
 }
 
 //==============================================================================
-void CsoundPluginProcessor::createMatrixEventSequencer(int rows, int cols, String channel)
+// Sequencers are created by their widget, so reopening the editor replaces the
+// existing sequencer for a channel rather than adding a second one.
+void CsoundPluginProcessor::createMatrixEventSequencer(int cols, int rows, String channel, bool vertical)
 {
-    MatrixEventSequencer* matrix = new MatrixEventSequencer(channel);
+    CabbageMatrixEventSequencer* matrix = new CabbageMatrixEventSequencer(channel, cols, rows, vertical);
 
-    for (int i = 0 ; i < cols ; i++)
-    {
-        matrix->events.add (new StringArray());
+    if (csdCompiledWithoutError())
+        matrix->setPositionChannel(matrix->findPositionChannel(*csound));
+
+    const ScopedLock lock (matrixEventSequencerLock);
 
-        for ( int y = 0 ; y < rows ; y++)
+    for (int i = 0; i < matrixEventSequencers.size(); i++)
+    {
+        if (matrixEventSequencers[i]->getChannel() == channel)
         {
-            matrix->events[i]->add(" ");
+            matrixEventSequencers.set(i, matrix);
+            return;
         }
     }
 
     matrixEventSequencers.add(matrix);
 	numMatrixEventSequencers = matrixEventSequencers.size();
-
-
 }
 
 void CsoundPluginProcessor::setMatrixEventSequencerCellData(int col, int row, String channel, String data)
 {
-	if (numMatrixEventSequencers > 0)
+	for (auto* matrix : matrixEventSequencers)
 	{
-		for (int i = 0; i < matrixEventSequencers.size(); i++)
-		{
-			if (matrixEventSequencers[i]->channel == channel)
-			{
-				matrixEventSequencers[i]->setEventString(col, row, data);
-			}
-		}
+		if (matrix->getChannel() == channel)
+			matrix->setCellData(col, row, data);
 	}
 }
 
@@ -541,44 +834,51 @@ void CsoundPluginProcessor::changeProgramName (int index, const String& newName)
 //==============================================================================
 void CsoundPluginProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    hostBlockSize = samplesPerBlock;
+
     // check for a change in sampling rate - also check if host is logic..
     if(samplingRate != sampleRate || isLogic)
     {
         //if sampling rate is other than default or has been changed, recompile..
-        samplingRate = sampleRate;
-        CabbageUtilities::debug(csdFile.getFullPathName());
-        //allow mono plugins for Logic only..
-        if(isLogicAndMono == true)
-            setupAndCompileCsound(csdFile, csdFilePath, samplingRate, true);
-        else
+        samplingRate = sampleRate;
+        CabbageUtilities::debug(csdFile.getFullPathName());
+        //allow mono plugins for Logic only..
+        if (csdCompiledFromMemory && csdDocument != nullptr)
+            setupAndCompileCsound(csdDocument, csdFile, csdFilePath, samplingRate, isLogicAndMono);
+        else if(isLogicAndMono == true)
+            setupAndCompileCsound(csdFile, csdFilePath, samplingRate, true);
+        else
             setupAndCompileCsound(csdFile, csdFilePath, samplingRate);
     }
+
+    selectProcessingMode(samplesPerBlock);
 }
 
 void CsoundPluginProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    stopRenderAhead();
 }
 
 bool CsoundPluginProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
-{
-    const auto& mainInput  = layouts.getMainInputChannelSet();
-    const String test = mainInput.getDescription();
+{
+    const auto& mainInput  = layouts.getMainInputChannelSet();
+    const String test = mainInput.getDescription();
     
 #if JucePlugin_IsMidiEffectz
     ignoreUnused (layouts);
     return true;
 #else
-    // This is the place where you check if the layout is supported.
-//    PluginHostType pluginType;
-//    if (! pluginType.isLogic())
-//    {
-       if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-            && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
-            return false;
-//    }
-
+    // This is the place where you check if the layout is supported.
+//    PluginHostType pluginType;
+//    if (! pluginType.isLogic())
+//    {
+       if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
+            && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+            return false;
+//    }
+
     
     // This checks if the input layout matches the output layout
 #if ! JucePlugin_IsSynth
@@ -594,34 +894,123 @@ bool CsoundPluginProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 //==========================================================================
 void CsoundPluginProcessor::triggerCsoundEvents()
 {
+    const ScopedTryLock lock (matrixEventSequencerLock);
 
+    if (lock.isLocked())
+        for (auto* matrix : matrixEventSequencers)
+            matrix->triggerEvents (*csound);
 }
 
 void CsoundPluginProcessor::handleAsyncUpdate()
 {
+    //the audio thread is done with a faded out instance, it is deleted here rather than there
+    if (retiringCsoundState == retiringDone)
+    {
+        std::unique_ptr<Csound> oldCsound (std::move (retiringCsound.csound));
+        retiringCsoundState = retiringNone;
+    }
+
+    File loggerFile;
+    std::unique_ptr<CompiledCsound> compiled;
+
+    {
+        const ScopedLock sl (backgroundCompileLock);
+        std::swap (loggerFile, pendingLoggerFile);
+        compiled = std::move (backgroundCompileResult);
+    }
+
+    if (loggerFile != File())
+        createFileLogger (loggerFile);
+
+    if (compiled != nullptr)
+    {
+        backgroundCompileInProgress = false;
+        backgroundCompileFinished (*compiled);
+    }
+
+    if (latencyChanged)
+    {
+        latencyChanged = false;
+        setLatencySamples (csdKsmps);
+    }
+
     getChannelDataFromCsound();
     sendChannelDataToCsound();
 }
 
-void CsoundPluginProcessor::sendHostDataToCsound()
+//==============================================================================
+// The host position is only queried once per processBlock. Each k-cycle then
+// writes it, along with the MIDI overflow counts, through the channel pointers
+// cached at compile time, and only touches the channels whose values have
+// actually changed.
+//==============================================================================
+bool CsoundPluginProcessor::fetchHostPosition (AudioPlayHead::CurrentPositionInfo& info)
 {
     if (CabbageUtilities::getTarget() != CabbageUtilities::TargetTypes::IDE)
     {
         if (AudioPlayHead* const ph = getPlayHead())
+            return ph->getCurrentPosition (info);
+    }
+
+    return false;
+}
+
+void CsoundPluginProcessor::publishHostPosition (const AudioPlayHead::CurrentPositionInfo& info)
+{
+    *hostPositionSnapshot.getWriteBuffer() = info;
+    hostPositionSnapshot.publish();
+}
+
+void CsoundPluginProcessor::resolveHostChannels (Csound& target, MYFLT** channelPointers)
+{
+    const String channelNames[numHostChannels] = { CabbageIdentifierIds::hostbpm,
+                                                   CabbageIdentifierIds::timeinseconds,
+                                                   CabbageIdentifierIds::isplaying,
+                                                   CabbageIdentifierIds::isrecording,
+                                                   CabbageIdentifierIds::hostppqpos,
+                                                   CabbageIdentifierIds::timeinsamples,
+                                                   CabbageIdentifierIds::timeSigDenom,
+                                                   CabbageIdentifierIds::timeSigNum,
+                                                   CabbageIdentifierIds::midiinoverflow,
+                                                   CabbageIdentifierIds::midioutoverflow };
+
+    for (int i = 0; i < numHostChannels; i++)
+        if (target.GetChannelPtr (channelPointers[i], channelNames[i].toUTF8(), CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL) != 0)
+            channelPointers[i] = nullptr;
+}
+
+void CsoundPluginProcessor::sendHostDataToCsound (int samplePos)
+{
+    double timeInSeconds = hostInfo.timeInSeconds;
+    double ppqPosition = hostInfo.ppqPosition;
+    int64 timeInSamples = hostInfo.timeInSamples;
+
+    if (interpolateHostPosition && hostInfo.isPlaying && samplePos > 0 && getSampleRate() > 0)
+    {
+        const double secondsIntoBlock = samplePos / getSampleRate();
+        timeInSeconds += secondsIntoBlock;
+        ppqPosition += secondsIntoBlock * hostInfo.bpm / 60.0;
+        timeInSamples += samplePos;
+    }
+
+    const MYFLT values[numHostChannels] = { MYFLT (hostInfo.bpm),
+                                            MYFLT (timeInSeconds),
+                                            MYFLT (hostInfo.isPlaying),
+                                            MYFLT (hostInfo.isRecording),
+                                            MYFLT (ppqPosition),
+                                            MYFLT (timeInSamples),
+                                            MYFLT (hostInfo.timeSigDenominator),
+                                            MYFLT (hostInfo.timeSigNumerator),
+                                            MYFLT (midiInputFifo.getNumDropped() + renderAheadMidiDropped),
+                                            MYFLT (midiOutputFifo.getNumDropped()) };
+
+    //transport channels are left alone when there is no valid play head
+    for (int i = (hostInfoIsValid ? 0 : midiInOverflowChannel); i < numHostChannels; i++)
+    {
+        if (hostChannelPointers[i] != nullptr && values[i] != hostChannelValues[i])
         {
-            AudioPlayHead::CurrentPositionInfo hostInfo;
-            
-            if (ph->getCurrentPosition (hostInfo))
-            {
-                csound->SetChannel (CabbageIdentifierIds::hostbpm.toUTF8(), hostInfo.bpm);
-                csound->SetChannel (CabbageIdentifierIds::timeinseconds.toUTF8(), hostInfo.timeInSeconds);
-                csound->SetChannel (CabbageIdentifierIds::isplaying.toUTF8(), hostInfo.isPlaying);
-                csound->SetChannel (CabbageIdentifierIds::isrecording.toUTF8(), hostInfo.isRecording);
-                csound->SetChannel (CabbageIdentifierIds::hostppqpos.toUTF8(), hostInfo.ppqPosition);
-                csound->SetChannel (CabbageIdentifierIds::timeinsamples.toUTF8(), hostInfo.timeInSamples);
-                csound->SetChannel (CabbageIdentifierIds::timeSigDenom.toUTF8(), hostInfo.timeSigDenominator);
-                csound->SetChannel (CabbageIdentifierIds::timeSigNum.toUTF8(), hostInfo.timeSigNumerator);
-            }
+            *hostChannelPointers[i] = values[i];
+            hostChannelValues[i] = values[i];
         }
     }
 }
@@ -630,76 +1019,111 @@ void CsoundPluginProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer&
     float** audioBuffers = buffer.getArrayOfWritePointers();
     const int numSamples = buffer.getNumSamples();
     
-    MYFLT newSamp;
-    int result = -1;
-
-
-	const int output_channel_count = (numCsoundChannels > getTotalNumOutputChannels() ? getTotalNumOutputChannels() : numCsoundChannels);
 
     //if no inputs are used clear buffer in case it's not empty..
     if (getTotalNumInputChannels() == 0)
         buffer.clear();
 
 	keyboardState.processNextMidiBuffer(midiMessages, 0, numSamples, true);
-	midiBuffer.addEvents(midiMessages, 0, numSamples, 0);
-    
 
+    //if a new instance is being swapped in this block is skipped
+    const ScopedTryLock swapLock (csoundSwapLock);
+
+    if (swapLock.isLocked() == false)
+    {
+        //the MIDI fifos may belong to the render ahead thread, so they are left alone
+        for (int channel = 0; channel < getTotalNumOutputChannels(); ++channel)
+            buffer.clear (channel, 0, numSamples);
+
+        return;
+    }
+
+    if (renderAheadActive)
+    {
+        processBlockRenderAhead (buffer, midiMessages);
+        return;
+    }
+
+    {
+        MidiBuffer::Iterator i (midiMessages);
+        const uint8* data;
+        int numBytes, samplePosition;
+
+        while (i.getNextEvent (data, numBytes, samplePosition))
+            midiInputFifo.addEvent (data, numBytes, samplePosition);
+    }
 
     if (csdCompiledWithoutError())
     {
+        const int output_channel_count = (numCsoundChannels > getTotalNumOutputChannels() ? getTotalNumOutputChannels() : numCsoundChannels);
+        hostInfoIsValid = fetchHostPosition (hostInfo);
+
+        if (hostInfoIsValid)
+            publishHostPosition (hostInfo);
+
+        //the instance being faded out renders from a copy of this block's input
+        const bool crossfading = (retiringCsoundState == retiringFading);
+
+        if (crossfading && numSamples <= crossfadeBuffer.getNumSamples())
+        {
+            for (int channel = 0; channel < jmin (crossfadeBuffer.getNumChannels(), buffer.getNumChannels()); ++channel)
+                crossfadeBuffer.copyFrom (channel, 0, buffer, channel, 0, numSamples);
+        }
+
         //mute unused channels
         for (int channelsToClear = output_channel_count; channelsToClear < getTotalNumOutputChannels(); ++channelsToClear)
         {
             buffer.clear (channelsToClear, 0, buffer.getNumSamples());
         }
 
-        for (int i = 0; i < numSamples; i++, ++csndIndex)
+        //some hosts send the odd short block even though they promised a fixed size
+        if (alignedProcessing && numSamples % csdKsmps != 0)
+            disableAlignedProcessing();
+
+        if (alignedProcessing)
         {
-            if (csndIndex == csdKsmps)
+            //zero latency - each ksmps chunk of the host buffer is processed in place
+            for (int samplePos = 0; samplePos < numSamples; samplePos += csdKsmps)
             {
-                    result = csound->PerformKsmps();
+                csndIndex = 0;
+                writeInputToCsound (audioBuffers, output_channel_count, samplePos, csdKsmps);
 
-                if (result == 0)
-                {
-                    //slow down calls to these functions, no need for them to be firing at k-rate
-                    if (guiCycles > guiRefreshRate)
-                    {
-                        guiCycles = 0;
-                        triggerAsyncUpdate();
-                    }
-                    else
-                        ++guiCycles;
-
-                    //trigger any Csound score event on each k-boundary
-                    triggerCsoundEvents();
-                    sendHostDataToCsound();
-
-                    disableLogging = false;
-                }
-                else
-                {
-                    disableLogging = true;
+                if (performCsoundKsmps (samplePos) == false)
                     return; //return as soon as Csound has stopped
-                }
-
-                csndIndex = 0;
 
+                readOutputFromCsound (audioBuffers, output_channel_count, samplePos, csdKsmps);
+                csndIndex = csdKsmps;
             }
+        }
+        else
+        {
+            int samplePos = 0;
 
-            pos = csndIndex * output_channel_count;
-
-            for (int channel = 0; channel < output_channel_count; ++channel)
+            while (samplePos < numSamples)
             {
-                float*& current_sample = audioBuffers[channel];
-                newSamp = *current_sample * cs_scale;
-                CSspin[pos] = newSamp;
-                *current_sample = (CSspout[pos] / cs_scale);
-                ++current_sample;
-                pos++;
+                if (csndIndex == csdKsmps)
+                {
+                    if (performCsoundKsmps (samplePos) == false)
+                        return; //return as soon as Csound has stopped
 
+                    csndIndex = 0;
+                }
+
+                //copy everything up to the next k-boundary, or the end of the host block, in one go
+                const int samplesToProcess = jmin (csdKsmps - csndIndex, numSamples - samplePos);
+                writeInputToCsound (audioBuffers, output_channel_count, samplePos, samplesToProcess);
+                readOutputFromCsound (audioBuffers, output_channel_count, samplePos, samplesToProcess);
+
+                csndIndex += samplesToProcess;
+                samplePos += samplesToProcess;
             }
         }
 
+        if (crossfading)
+            crossfadeRetiringCsound (buffer, output_channel_count);
+
+        //events the block ended too early for are due at the start of the next one
+        midiInputFifo.compact();
 
     }//if not compiled just mute output
     else
@@ -708,21 +1132,477 @@ void CsoundPluginProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer&
         {
             buffer.clear (channel, 0, buffer.getNumSamples());
         }
+
+        midiInputFifo.clear();
     }
 
 #if JucePlugin_ProducesMidiOutput
 
-    if (!midiOutputBuffer.isEmpty())
+    midiMessages.clear();
+
     {
-        midiMessages.clear();
-        midiMessages.swapWith (midiOutputBuffer);
+        const uint8* data;
+        int numBytes, samplePosition;
+
+        while (midiOutputFifo.getNextEvent (data, numBytes, samplePosition))
+        {
+            midiMessages.addEvent (data, numBytes, jlimit (0, jmax (0, numSamples - 1), samplePosition));
+            midiOutputFifo.readNextEvent();
+        }
+    }
+
+#endif
+
+    midiOutputFifo.clear();
+}
+
+//==============================================================================
+// Performs the instance a hot reload replaced over the input saved in
+// crossfadeBuffer, and fades from it to the new instance's output. It gets no
+// MIDI, host or channel updates, it only has to last for the length of the fade.
+//==============================================================================
+void CsoundPluginProcessor::crossfadeRetiringCsound (AudioSampleBuffer& buffer, int numChannels)
+{
+    RetiringCsound& retiring = retiringCsound;
+    const int numSamples = buffer.getNumSamples();
+    const int retiringChannels = jmin (numChannels, retiring.numChannels, crossfadeBuffer.getNumChannels());
+    int samplePos = 0;
+
+    //the host sent a bigger block than it said it would, cut the old instance off
+    if (numSamples > crossfadeBuffer.getNumSamples())
+    {
+        retiringCsoundState = retiringDone;
+        triggerAsyncUpdate();
+        return;
+    }
+
+    while (samplePos < numSamples)
+    {
+        if (retiring.index == retiring.ksmps)
+        {
+            if (retiring.csound->PerformKsmps() != 0)
+                break;
+
+            retiring.index = 0;
+        }
+
+        const int samplesToProcess = jmin (retiring.ksmps - retiring.index, numSamples - samplePos);
+        const int frameOffset = retiring.index * retiring.numChannels;
+
+        for (int channel = 0; channel < retiringChannels; ++channel)
+        {
+            float* samples = crossfadeBuffer.getWritePointer (channel, samplePos);
+            MYFLT* spin = retiring.spin + frameOffset + channel;
+            const MYFLT* spout = retiring.spout + frameOffset + channel;
+
+            for (int i = 0; i < samplesToProcess; ++i)
+            {
+                spin[i * retiring.numChannels] = samples[i] * retiring.scale;
+                samples[i] = float (spout[i * retiring.numChannels] / retiring.scale);
+            }
+        }
+
+        retiring.index += samplesToProcess;
+        samplePos += samplesToProcess;
+    }
+
+    //whatever the old instance didn't get to render, because it stopped, fades out as silence
+    if (samplePos < numSamples)
+        for (int channel = 0; channel < retiringChannels; ++channel)
+            crossfadeBuffer.clear (channel, samplePos, numSamples - samplePos);
+
+    const int samplesToFade = jmin (numSamples, retiring.fadeSamplesLeft);
+    const float fadeStep = 1.0f / float (retiring.fadeLength);
+    const float startGain = float (retiring.fadeSamplesLeft) * fadeStep;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        float* samples = buffer.getWritePointer (channel);
+        const float* oldSamples = channel < retiringChannels ? crossfadeBuffer.getReadPointer (channel) : nullptr;
+
+        for (int i = 0; i < samplesToFade; ++i)
+        {
+            const float oldGain = startGain - float (i) * fadeStep;
+            samples[i] = samples[i] * (1.0f - oldGain) + (oldSamples != nullptr ? oldSamples[i] * oldGain : 0.0f);
+        }
+    }
+
+    retiring.fadeSamplesLeft = (samplePos < numSamples ? 0 : retiring.fadeSamplesLeft - samplesToFade);
+
+    if (retiring.fadeSamplesLeft <= 0)
+    {
+        retiringCsoundState = retiringDone;
+        triggerAsyncUpdate();
+    }
+}
+
+//==============================================================================
+// Runs a single k-cycle along with the housekeeping that goes with it. Returns
+// false once Csound has finished performing. samplePos is where this k-cycle
+// starts within the current host block.
+//==============================================================================
+bool CsoundPluginProcessor::performCsoundKsmps (int samplePos)
+{
+    //ReadMidiData() only hands over events that fall within this k-period
+    midiSliceEnd = samplePos + csdKsmps;
+
+    //host data goes in first so this k-cycle sees the position it is rendered at
+    sendHostDataToCsound (samplePos);
+
+    if (csound->PerformKsmps() != 0)
+    {
+        disableLogging = true;
+        return false;
+    }
+
+    //slow down calls to these functions, no need for them to be firing at k-rate
+    if (guiCycles > guiRefreshRate)
+    {
+        guiCycles = 0;
+        updatePolledChannelSnapshot();
+        triggerAsyncUpdate();
+    }
+    else
+        ++guiCycles;
+
+    //trigger any Csound score event on each k-boundary
+    triggerCsoundEvents();
+
+    disableLogging = false;
+    return true;
+}
+
+//==============================================================================
+// Copy a run of host samples into Csound's spin buffer, or the matching frames
+// out of spout, starting at the current csndIndex. Csound's buffers are
+// interleaved with a stride of nchnls, the host's are not. Stereo goes through
+// the paired kernels, anything else a channel at a time.
+//==============================================================================
+void CsoundPluginProcessor::writeInputToCsound (float** audioBuffers, int numChannels, int startSample, int numSamples)
+{
+    MYFLT* spin = CSspin + csndIndex * numCsoundChannels;
+
+    if (numChannels == 2 && numCsoundChannels == 2)
+    {
+        CabbageInterleave::interleavePair (spin, audioBuffers[0] + startSample, audioBuffers[1] + startSample, numSamples, cs_scale);
+        return;
+    }
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        CabbageInterleave::interleave (spin + channel, numCsoundChannels, audioBuffers[channel] + startSample, numSamples, cs_scale);
+}
+
+void CsoundPluginProcessor::readOutputFromCsound (float** audioBuffers, int numChannels, int startSample, int numSamples)
+{
+    const MYFLT inverseScale = 1.0 / cs_scale;
+    const MYFLT* spout = CSspout + csndIndex * numCsoundChannels;
+
+    if (numChannels == 2 && numCsoundChannels == 2)
+    {
+        CabbageInterleave::deinterleavePair (audioBuffers[0] + startSample, audioBuffers[1] + startSample, spout, numSamples, inverseScale);
+        return;
+    }
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        CabbageInterleave::deinterleave (audioBuffers[channel] + startSample, spout + channel, numCsoundChannels, numSamples, inverseScale);
+}
+
+//==============================================================================
+// When the host block size is a whole multiple of ksmps each k-cycle can be run
+// in place on the host buffer, so no samples need to be held back and we can
+// report zero latency. Anything else uses the csndIndex buffering, which costs
+// ksmps samples of latency.
+//==============================================================================
+void CsoundPluginProcessor::selectProcessingMode (int samplesPerBlock)
+{
+    hostBlockSize = samplesPerBlock;
+    stopRenderAhead();
+
+    if (csdCompiledWithoutError() == false)
+        return;
+
+    {
+        const ScopedLock swapLock (csoundSwapLock);
+        alignedProcessing = (hostBlockSize > 0 && hostBlockSize % csdKsmps == 0);
+        csndIndex = csdKsmps;
+    }
+
+    applyRenderAhead();
+}
+
+//starts render ahead if it has been asked for, and reports the latency of whichever
+//mode is in use. Render ahead has to be stopped, and the swap lock not held
+void CsoundPluginProcessor::applyRenderAhead()
+{
+    //offline renders run Csound inline, so nothing can underrun and every bounce comes out the same
+    if (renderAheadRequested > 0 && hostBlockSize > 0 && ! isNonRealtime())
+    {
+        startRenderAhead();
+        setLatencySamples (renderAheadDepth);
     }
     else
-        midiMessages.clear();
+        setLatencySamples (alignedProcessing ? 0 : csdKsmps);
+}
+
+void CsoundPluginProcessor::disableAlignedProcessing()
+{
+    //whatever is left in spin/spout has already been played, so start the
+    //buffered path from a clean frame. Latency is reported from the message thread.
+    alignedProcessing = false;
+    FloatVectorOperations::clear (CSspin, csdKsmps * numCsoundChannels);
+    FloatVectorOperations::clear (CSspout, csdKsmps * numCsoundChannels);
+    csndIndex = 0;
+    latencyChanged = true;
+    triggerAsyncUpdate();
+}
+
+//==============================================================================
+// Render ahead mode. processBlock() queues the host's input, MIDI and position,
+// and plays back output that renderAheadThread produced earlier. The output
+// queue starts out holding renderAheadDepth samples of silence, so host sample
+// n is rendered from input sample n and heard at n + renderAheadDepth. If the
+// render thread falls behind the host gets silence, and the samples that
+// arrive late are thrown away, so the latency never drifts from what was
+// reported.
+//==============================================================================
+void CsoundPluginProcessor::setRenderAhead (int samples)
+{
+    //restarting empties the queues, so it is only done if the depth actually changes
+    if (jmax (0, samples) == renderAheadRequested)
+        return;
+
+    renderAheadRequested = jmax (0, samples);
+    selectProcessingMode (hostBlockSize);
+}
+
+void CsoundPluginProcessor::startRenderAhead()
+{
+    //a host block has to have arrived before any of it can be rendered, and the
+    //k-cycle it ends in has to be rendered before any of it can be played
+    const int minimumDepth = hostBlockSize + csdKsmps;
+    renderAheadDepth = ((jmax (renderAheadRequested, minimumDepth) + csdKsmps - 1) / csdKsmps) * csdKsmps;
+
+    const int capacity = renderAheadDepth + 4 * jmax (hostBlockSize, csdKsmps);
+    renderAheadInput.setSize (numCsoundChannels, capacity);
+    renderAheadOutput.setSize (numCsoundChannels, capacity);
+    renderAheadOutput.write (nullptr, 0, renderAheadDepth);
+    renderAheadScratch.setSize (numCsoundChannels, csdKsmps);
+    renderAheadBlocks.setCapacity (256);
+    renderAheadMidiInput.setCapacity (1024);
+    renderAheadMidiOutput.setCapacity (1024);
+
+    renderAheadHostPosition = 0;
+    renderAheadOutputOffset = 0;
+    renderAheadRenderPosition = 0;
+    renderAheadCurrentBlock = RenderAheadBlock();
+
+    //the thread idles until processBlock() starts queuing input for it
+    renderAheadThread.startThread (10);
+
+    {
+        //processBlock() uses the MIDI fifos itself until it is switched over
+        const ScopedLock swapLock (csoundSwapLock);
+        midiInputFifo.clear();
+        midiOutputFifo.clear();
+        renderAheadActive = true;
+    }
+}
+
+//never called with csoundSwapLock held, processBlock() carries on while this waits
+void CsoundPluginProcessor::stopRenderAhead()
+{
+    //the thread checks between k-cycles, it is never killed part way through one as that
+    //would leave Csound and the fifos half updated, however long a slow cycle takes.
+    //processBlock() keeps queuing, and plays any underrun as silence, until it is gone
+    renderAheadThread.signalThreadShouldExit();
+    renderAheadThread.notify();
+    renderAheadThread.stopThread (-1);
+
+    //from here processBlock() performs Csound itself, from the start of a k-cycle
+    if (renderAheadActive)
+    {
+        csndIndex = csdKsmps;
+        renderAheadActive = false;
+    }
+}
+
+void CsoundPluginProcessor::processBlockRenderAhead (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
+{
+    const int numSamples = buffer.getNumSamples();
+    const int output_channel_count = jmin (numCsoundChannels, getTotalNumOutputChannels());
+    const int64 blockStart = renderAheadHostPosition;
+
+    RenderAheadBlock block;
+    block.startSample = blockStart;
+    block.numSamples = numSamples;
+    block.hostInfoIsValid = fetchHostPosition (block.hostInfo);
+    renderAheadBlocks.push (block);
+
+    if (block.hostInfoIsValid)
+        publishHostPosition (block.hostInfo);
+
+    {
+        MidiBuffer::Iterator i (midiMessages);
+        const uint8* data;
+        int numBytes, samplePosition;
+        RenderAheadMidiEvent event;
+
+        while (i.getNextEvent (data, numBytes, samplePosition))
+        {
+            event.time = blockStart + samplePosition;
+            event.numBytes = numBytes;
+
+            if (numBytes <= 0 || numBytes > renderAheadMaxMidiBytes)
+            {
+                ++renderAheadMidiDropped;
+                continue;
+            }
+
+            memcpy (event.data, data, (size_t) numBytes);
+
+            if (renderAheadMidiInput.push (event) == false)
+                ++renderAheadMidiDropped;
+        }
+    }
+
+    //input that doesn't fit is lost, and the host is owed that much silence to stay in step
+    const int numWritten = renderAheadInput.write (buffer.getArrayOfReadPointers(), output_channel_count, numSamples);
+    renderAheadOutputOffset -= numSamples - numWritten;
+    renderAheadHostPosition += numSamples;
+    renderAheadThread.notify();
+
+    float** audioBuffers = buffer.getArrayOfWritePointers();
+    int samplePos = 0;
+
+    if (renderAheadOutputOffset > 0)
+        renderAheadOutputOffset -= renderAheadOutput.discard (renderAheadOutputOffset);
+
+    if (renderAheadOutputOffset < 0)
+    {
+        samplePos = jmin (numSamples, -renderAheadOutputOffset);
+        renderAheadOutputOffset += samplePos;
+
+        for (int channel = 0; channel < output_channel_count; ++channel)
+            buffer.clear (channel, 0, samplePos);
+    }
+
+    samplePos += renderAheadOutput.read (audioBuffers, output_channel_count, samplePos, numSamples - samplePos);
+
+    if (samplePos < numSamples)
+    {
+        for (int channel = 0; channel < output_channel_count; ++channel)
+            buffer.clear (channel, samplePos, numSamples - samplePos);
+
+        renderAheadOutputOffset += numSamples - samplePos;
+        ++renderAheadUnderruns;
+    }
+
+    //mute unused channels
+    for (int channelsToClear = output_channel_count; channelsToClear < getTotalNumOutputChannels(); ++channelsToClear)
+        buffer.clear (channelsToClear, 0, numSamples);
+
+#if JucePlugin_ProducesMidiOutput
+
+    midiMessages.clear();
+
+    while (const RenderAheadMidiEvent* event = renderAheadMidiOutput.peek())
+    {
+        if (event->time >= blockStart + numSamples)
+            break;
+
+        midiMessages.addEvent (event->data, event->numBytes, int (jlimit<int64> (0, numSamples - 1, event->time - blockStart)));
+        renderAheadMidiOutput.discardNext();
+    }
 
 #endif
 }
 
+void CsoundPluginProcessor::runRenderAhead()
+{
+    while (renderAheadThread.threadShouldExit() == false)
+    {
+        while (renderAheadInput.getNumReady() >= csdKsmps && renderAheadOutput.getFreeSpace() >= csdKsmps)
+        {
+            renderAheadKsmps();
+
+            if (renderAheadThread.threadShouldExit())
+                return;
+        }
+
+        //woken by processBlock() as soon as there is more input
+        renderAheadThread.wait (10);
+    }
+}
+
+//==============================================================================
+// One k-cycle on the render thread. The midi and host data fifos are only ever
+// touched from here while render ahead is running.
+//==============================================================================
+void CsoundPluginProcessor::renderAheadKsmps()
+{
+    const int64 renderPosition = renderAheadRenderPosition;
+    RenderAheadBlock& block = renderAheadCurrentBlock;
+
+    //the host block this k-cycle starts in supplies the transport position
+    while (renderPosition >= block.startSample + block.numSamples && renderAheadBlocks.pop (block))
+    {}
+
+    hostInfo = block.hostInfo;
+    hostInfoIsValid = block.hostInfoIsValid;
+    const int samplePos = int (jlimit<int64> (0, jmax (0, block.numSamples - 1), renderPosition - block.startSample));
+
+    //Csound only reads MIDI once per k-cycle, so everything due within it is handed over at its start
+    midiInputFifo.compact();
+
+    while (const RenderAheadMidiEvent* event = renderAheadMidiInput.peek())
+    {
+        if (event->time >= renderPosition + csdKsmps)
+            break;
+
+        midiInputFifo.addEvent (event->data, event->numBytes, samplePos);
+        renderAheadMidiInput.discardNext();
+    }
+
+    float** scratch = renderAheadScratch.getArrayOfWritePointers();
+    renderAheadInput.read (scratch, numCsoundChannels, 0, csdKsmps);
+
+    csndIndex = 0;
+    writeInputToCsound (scratch, numCsoundChannels, 0, csdKsmps);
+
+    if (performCsoundKsmps (samplePos))
+        readOutputFromCsound (scratch, numCsoundChannels, 0, csdKsmps);
+    else
+        renderAheadScratch.clear();
+
+    renderAheadOutput.write (renderAheadScratch.getArrayOfReadPointers(), numCsoundChannels, csdKsmps);
+
+#if JucePlugin_ProducesMidiOutput
+
+    {
+        const uint8* data;
+        int numBytes, samplePosition;
+        RenderAheadMidiEvent event;
+        event.time = renderPosition + renderAheadDepth;
+
+        while (midiOutputFifo.getNextEvent (data, numBytes, samplePosition))
+        {
+            if (numBytes <= renderAheadMaxMidiBytes)
+            {
+                event.numBytes = numBytes;
+                memcpy (event.data, data, (size_t) numBytes);
+                renderAheadMidiOutput.push (event);
+            }
+
+            midiOutputFifo.readNextEvent();
+        }
+    }
+
+#endif
+
+    midiOutputFifo.clear();
+    renderAheadRenderPosition += csdKsmps;
+}
+
 //==============================================================================
 void CsoundPluginProcessor::breakpointCallback (CSOUND* csound, debug_bkpt_info_t* bkpt_info, void* userdata)
 {
@@ -766,27 +1646,63 @@ void CsoundPluginProcessor::breakpointCallback (CSOUND* csound, debug_bkpt_info_
 }
 
 //==============================================================================
-CsoundPluginProcessor::SignalDisplay* CsoundPluginProcessor::getSignalArray (String variableName, String displayType)
+// Looks up a display by the name of the signal it shows. Waveform and lissajous
+// widgets want the plain display opcodes, everything else wants dispfft. Displays
+// whose caption couldn't be parsed are found by the old caption search and then
+// remembered. Unknown names get an empty display that never has new points.
+//==============================================================================
+CsoundPluginProcessor::SignalDisplay* CsoundPluginProcessor::getSignalArray (const String& variableName, const String& displayType)
 {
-    for (int i = 0; i < signalArrays.size(); i++)
-    {
-        if (signalArrays[i]->caption.isNotEmpty() && signalArrays[i]->caption.contains (variableName))
-        {
-            if (displayType.isEmpty())
-                return signalArrays[i];
+    static SignalDisplay emptySignalDisplay ("", 0, 0, 0, 0, 0);
+
+    //Csound registers displays from its performing thread while the editor looks them up
+    const CriticalSection::ScopedLockType lock (signalArrays.getLock());
+    const bool wantsWaveform = (displayType == "waveform" || displayType == "lissajous");
+    const bool wantsFFT = (wantsWaveform == false);
 
-            else if (displayType == "waveform" && !signalArrays[i]->caption.contains ("fft"))
-                return signalArrays[i];
+    if (displayType.isEmpty() || wantsWaveform)
+        if (SignalDisplay* display = waveformDisplaysByName[variableName])
+            return display;
 
-            else if (displayType == "lissajous" && !signalArrays[i]->caption.contains ("fft"))
-                return signalArrays[i];
+    if (displayType.isEmpty() || wantsFFT)
+        if (SignalDisplay* display = fftDisplaysByName[variableName])
+            return display;
 
-            else if (displayType != "waveform" && signalArrays[i]->caption.contains ("fft"))
-                return signalArrays[i];
+    if (variableName.isNotEmpty())
+    {
+        for (auto* display : signalArrays)
+        {
+            if (display->caption.isNotEmpty() && display->caption.contains (variableName))
+            {
+                const bool isFFT = display->caption.contains ("fft");
+
+                if (displayType.isEmpty() || isFFT == wantsFFT)
+                {
+                    (isFFT ? fftDisplaysByName : waveformDisplaysByName).set (variableName, display);
+                    return display;
+                }
+            }
         }
     }
 
-    return new SignalDisplay ("", -1, 0, 0, 0, 0);
+    return &emptySignalDisplay;
+}
+
+//==============================================================================
+// Csound's display captions read "instr 1, signal aSig:" or, for dispfft,
+// "instr 1, signal aSig, fft (...)". Returns an empty string for anything else.
+//==============================================================================
+String CsoundPluginProcessor::getSignalVariableFromCaption (const String& caption)
+{
+    const int start = caption.indexOf ("signal ");
+
+    if (start < 0)
+        return String();
+
+    return caption.substring (start + 7)
+                  .upToFirstOccurrenceOf (",", false, false)
+                  .upToFirstOccurrenceOf (":", false, false)
+                  .trim();
 }
 //==============================================================================
 bool CsoundPluginProcessor::hasEditor() const
@@ -821,9 +1737,11 @@ int CsoundPluginProcessor::OpenMidiInputDevice (CSOUND* csound, void** userData,
 }
 
 //==============================================================================
-// Reads MIDI input data from host, gets called every time there is MIDI input to our plugin
+// Reads MIDI input data from host. Called by Csound on each k-cycle, it passes on
+// the events whose sample offset falls before the end of the current k-period,
+// so notes start on the k-cycle closest to where the host placed them.
 //==============================================================================
-int CsoundPluginProcessor::ReadMidiData (CSOUND* /*csound*/, void* userData,
+int CsoundPluginProcessor::ReadMidiData (CSOUND* csound, void* userData,
                                          unsigned char* mbuf, int nbytes)
 {
     CsoundPluginProcessor* midiData = (CsoundPluginProcessor*)userData;
@@ -834,36 +1752,34 @@ int CsoundPluginProcessor::ReadMidiData (CSOUND* /*csound*/, void* userData,
         return 0;
     }
 
+    //an instance being faded out after a reload gets no new MIDI
+    if (midiData->csound == nullptr || csound != midiData->csound->GetCsound())
+        return 0;
+
     int cnt = 0;
 
     
-    if (!midiData->midiBuffer.isEmpty() && cnt <= (nbytes - 3))
+    const uint8* data;
+    int numBytes, messageFrameRelativeTothisProcess;
+
+    while (midiData->midiInputFifo.getNextEvent (data, numBytes, messageFrameRelativeTothisProcess))
     {
-        MidiMessage message (0xf4, 0, 0, 0);
-        MidiBuffer::Iterator i (midiData->midiBuffer);
-        int messageFrameRelativeTothisProcess;
+        if (messageFrameRelativeTothisProcess >= midiData->midiSliceEnd)
+            break;
 
-        while (i.getNextEvent (message, messageFrameRelativeTothisProcess))
+        //a sysex dump bigger than Csound's whole buffer can never be delivered
+        if (numBytes > nbytes)
         {
-            
-            const uint8* data = message.getRawData();
-            *mbuf++ = *data++;
-
-            if(message.isChannelPressure() || message.isProgramChange())
-            {
-                *mbuf++ = *data++;
-                cnt += 2;
-            }
-            else
-            {
-                *mbuf++ = *data++;
-                *mbuf++ = *data++;
-                cnt  += 3;
-            }
+            midiData->midiInputFifo.dropNextEvent();
+            continue;
         }
 
-        midiData->midiBuffer.clear();
-        
+        if (cnt + numBytes > nbytes)
+            break;
+
+        memcpy (mbuf + cnt, data, (size_t) numBytes);
+        cnt += numBytes;
+        midiData->midiInputFifo.readNextEvent();
     }
 
     
@@ -883,9 +1799,10 @@ int CsoundPluginProcessor::OpenMidiOutputDevice (CSOUND* csound, void** userData
 
 //==============================================================================
 // Write MIDI data to plugin's MIDI output. Each time Csound outputs a midi message this
-// method should be called. Note: you must have -Q set in your CsOptions
+// method should be called. Note: you must have -Q set in your CsOptions. Messages are
+// stamped with the start of the current k-cycle within the host block.
 //==============================================================================
-int CsoundPluginProcessor::WriteMidiData (CSOUND* /*csound*/, void* _userData,
+int CsoundPluginProcessor::WriteMidiData (CSOUND* csound, void* _userData,
                                           const unsigned char* mbuf, int nbytes)
 {
     CsoundPluginProcessor* userData = (CsoundPluginProcessor*)_userData;
@@ -896,8 +1813,29 @@ int CsoundPluginProcessor::WriteMidiData (CSOUND* /*csound*/, void* _userData,
         return 0;
     }
 
-    MidiMessage message (mbuf, nbytes, 0);
-    userData->midiOutputBuffer.addEvent (message, 0);
+    if (userData->csound == nullptr || csound != userData->csound->GetCsound())
+        return nbytes;
+
+    const int samplePosition = jmax (0, userData->midiSliceEnd - userData->csdKsmps);
+    int pos = 0;
+
+    //mbuf may hold more than one message
+    while (pos < nbytes)
+    {
+        int size = 1;
+
+        if (mbuf[pos] == 0xf0)
+        {
+            while (pos + size < nbytes && mbuf[pos + size - 1] != 0xf7)
+                size++;
+        }
+        else
+            size = jmin (MidiMessage::getMessageLengthFromFirstByte (mbuf[pos]), nbytes - pos);
+
+        userData->midiOutputFifo.addEvent (mbuf + pos, size, samplePosition);
+        pos += size;
+    }
+
     return nbytes;
 }
 
@@ -905,31 +1843,65 @@ int CsoundPluginProcessor::WriteMidiData (CSOUND* /*csound*/, void* _userData,
 // graphing functions...
 //===========================================================================================
 
-void CsoundPluginProcessor::makeGraphCallback (CSOUND* csound, WINDAT* windat, const char* /*name*/)
+//==============================================================================
+// Displays are keyed by windid for the draw callback, and by signal name for the
+// editor. A display opcode that is re-initialised gets a new windid, in which case
+// the display with the same caption is moved over to it.
+//==============================================================================
+void CsoundPluginProcessor::registerSignalDisplay (CSOUND* instance, const WINDAT* windat)
 {
-    CsoundPluginProcessor* ud = (CsoundPluginProcessor*) csoundGetHostData (csound);
-    SignalDisplay* display = new SignalDisplay (String (windat->caption), windat->windid, windat->oabsmax, windat->min, windat->max, windat->npts);
+    const CriticalSection::ScopedLockType lock (signalArrays.getLock());
+    HashMap<uint64, SignalDisplay*>& displaysByWindow = getSignalDisplaysByWindow (instance);
+    const uint64 windowKey = (uint64) windat->windid;
 
-    bool addDisplay = true;
+    if (displaysByWindow.contains (windowKey))
+        return;
 
-    for (int i = 0; i < ud->signalArrays.size(); i++)
+    for (auto* display : signalArrays)
     {
-        if (ud->signalArrays[i]->caption == windat->caption)
-            addDisplay  = false;
+        if (display->caption == windat->caption)
+        {
+            displaysByWindow.remove ((uint64) display->windid);
+            display->windid = windat->windid;
+            displaysByWindow.set (windowKey, display);
+            return;
+        }
     }
 
-    if (addDisplay)
-        ud->signalArrays.add (display);
+    const String caption (windat->caption);
+    SignalDisplay* display = signalArrays.add (new SignalDisplay (caption, windat->windid, windat->oabsmax, windat->min, windat->max, windat->npts));
+    displaysByWindow.set (windowKey, display);
+
+    const String variableName = getSignalVariableFromCaption (caption);
+
+    if (variableName.isNotEmpty())
+        (caption.contains ("fft") ? fftDisplaysByName : waveformDisplaysByName).set (variableName, display);
+}
+
+//must be called with signalArrays' lock held
+HashMap<uint64, CsoundPluginProcessor::SignalDisplay*>& CsoundPluginProcessor::getSignalDisplaysByWindow (CSOUND* instance)
+{
+    return (instance != nullptr && instance == pendingSignalDisplayCsound) ? pendingSignalDisplaysByWindow : signalDisplaysByWindow;
+}
+
+void CsoundPluginProcessor::makeGraphCallback (CSOUND* csound, WINDAT* windat, const char* /*name*/)
+{
+    CsoundPluginProcessor* ud = (CsoundPluginProcessor*) csoundGetHostData (csound);
+    ud->registerSignalDisplay (csound, windat);
 }
 
 void CsoundPluginProcessor::drawGraphCallback (CSOUND* csound, WINDAT* windat)
 {
     CsoundPluginProcessor* ud = (CsoundPluginProcessor*) csoundGetHostData (csound);
-    Array<float, CriticalSection> tablePoints;
-    //only take all samples if dealing with fft, waveforms and lissajous curves can be drawn with less samples
-    tablePoints = Array<float, CriticalSection> (&windat->fdata[0], windat->npts);
-    ud->getSignalArray (windat->caption)->setPoints (tablePoints);
-    ud->updateSignalDisplay = true;
+
+    //a frame is dropped rather than the performing thread waiting on the editor
+    const CriticalSection::ScopedTryLockType lock (ud->signalArrays.getLock());
+
+    if (! lock.isLocked())
+        return;
+
+    if (SignalDisplay* display = ud->getSignalDisplaysByWindow (csound)[(uint64) windat->windid])
+        display->setPoints (windat->fdata, windat->npts);
 }
 
 void CsoundPluginProcessor::killGraphCallback (CSOUND* csound, WINDAT* windat)
@@ -27,6 +27,11 @@
 #include <cwindow.h>
 #include "../../Utilities/CabbageUtilities.h"
 #include "CabbageCsoundBreakpointData.h"
+#include "CabbageSnapshotBuffer.h"
+#include "CabbageMidiFifo.h"
+#include "CabbageLockFreeFifo.h"
+#include "CabbageInterleave.h"
+#include "CabbageMatrixEventSequencer.h"
 #ifdef CabbagePro
 #include "../../Utilities/encrypt.h"
 #endif
@@ -41,7 +46,34 @@ public:
 	void resetCsound();
     //==============================================================================
     //pass the path to the temp file, along with the path to the original csd file so we can set correct working dir
-	bool setupAndCompileCsound(File csdFile, File filePath, int sr = 44100, bool isMono = false, bool debugMode = false);
+	bool setupAndCompileCsound(File csdFile, File filePath, int sr = 44100, bool isMono = false, bool debugMode = false, bool compileFromMemory = false);
+    //compiles a csd that is already in memory, such as one another instance has preprocessed.
+    //csdFile is only the file it came from, a change of sample rate recompiles the same text
+    bool setupAndCompileCsound (std::shared_ptr<const CsdDocument> document, File csdFile, File filePath, int sr = 44100, bool isMono = false);
+
+    //A Csound instance that has been compiled and started, but doesn't perform
+    //until installCsound() puts it in place of the current one
+    struct CompiledCsound
+    {
+        std::unique_ptr<Csound> csound;
+        std::unique_ptr<CSOUND_PARAMS> params;
+        std::shared_ptr<const CsdDocument> document;
+        File csdFile, filePath;
+        int numChannels = 0;
+        int compileResult = -1;
+        int renderAhead = -1;   //what setRenderAhead() is to be set to as it is installed, -1 leaves it
+        bool fromMemory = false;
+    };
+
+    //compiles compiled.document if it has been set, otherwise the document loaded from csdFile
+    void compileCsoundInstance (CompiledCsound& compiled, File csdFile, File filePath, int sr, bool isMono, bool debugMode, bool compileFromMemory);
+    void installCsound (CompiledCsound& compiled, bool crossfade = false);
+    //compiles on a background thread while the current instance keeps playing, then
+    //calls backgroundCompileFinished() on the message thread, which by default swaps
+    //the new instance in with a crossfade if it compiled
+    void compileCsoundInBackground (File csdFile, File filePath, int sr);
+    virtual void backgroundCompileFinished (CompiledCsound& compiled);
+    bool isCompilingInBackground() const        { return backgroundCompileInProgress; }
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
@@ -103,25 +135,9 @@ public:
     int checkTable (int tableNum);
     AudioPlayHead::CurrentPositionInfo hostInfo;
 
-    class MatrixEventSequencer
-    {
-    public:
-        String channel = "";
-        OwnedArray<StringArray> events;
-        int position = 0;
-        void setEventString(int col, int row, String data)
-        {
-            events[col]->set(row, data);
-        }
-
-        MatrixEventSequencer(String csoundChannel):channel(csoundChannel){}
-        ~MatrixEventSequencer(){ events.clear();}
-
-    };
-
 	int numMatrixEventSequencers = 0;
-    void createMatrixEventSequencer(int rows, int cols, String channel);
-    void setMatrixEventSequencerCellData(int row, int col, String channel, String data);
+    void createMatrixEventSequencer(int cols, int rows, String channel, bool vertical = true);
+    void setMatrixEventSequencerCellData(int col, int row, String channel, String data);
     //=============================================================================
     //Implement these to init, send and receive channel data to Csound. Typically used when
     //a component is updated and its value is sent to Csound, or when a Csound channel
@@ -130,11 +146,25 @@ public:
     //as is done in CabbagePluginprocessor.
     virtual void triggerCsoundEvents();
     virtual void sendChannelDataToCsound() {};
-    void sendHostDataToCsound();
+    void sendHostDataToCsound (int samplePos);
     virtual void getChannelDataFromCsound() {};
     virtual void initAllCsoundChannels (ValueTree cabbageData);
+    //sets up an instance that has compiled but hasn't been installed yet
+    void initAllCsoundChannels (ValueTree cabbageData, CompiledCsound& compiled);
+    //installCsound() calls resolveChannelPointers() with the new instance before it is
+    //swapped in, or releaseChannelPointers() if there is none, so subclasses can move
+    //any raw channel pointers they hold over to it
+    virtual void releaseChannelPointers() {};
+    virtual void resolveChannelPointers (Csound& target) {};
+    //=============================================================================
+    //Control channels that the GUI reads back from Csound. Their values are copied
+    //into a snapshot on the audio thread at the GUI refresh rate, so the message
+    //thread never has to look channels up by name. getPolledChannelValues() returns
+    //nullptr if nothing new has arrived, unresolved channels are reported as NaN.
+    void setPolledChannels (const StringArray& channelNames);
+    const MYFLT* getPolledChannelValues();
     //=============================================================================
-    void addMacros (String csdText);
+    void addMacros (const CsdDocument& document, Csound& target);
     const String getCsoundOutput();
 
     void compileCsdFile (File csdFile)
@@ -159,6 +189,11 @@ public:
         return csound.get();
     }
 
+    std::shared_ptr<const CsdDocument> getCsdDocument() const
+    {
+        return csdDocument;
+    }
+
     CSOUND* getCsoundStruct()
     {
         return csound->GetCsound();
@@ -176,79 +211,258 @@ public:
         return numCsoundChannels;
     }
 
+    //picks the zero latency in-place path when the host block size is a multiple of ksmps
+    void selectProcessingMode (int samplesPerBlock);
+
+    bool isUsingAlignedProcessing()
+    {
+        return alignedProcessing;
+    }
+
+    //when enabled the host position channels are advanced to the start of each
+    //k-cycle within the block rather than holding the block start position
+    void setHostPositionInterpolation (bool shouldInterpolate)
+    {
+        interpolateHostPosition = shouldInterpolate;
+    }
+
+    //performs Csound on its own thread, up to this many samples ahead of the host,
+    //0 performs it in processBlock(). At least a host block plus a k-cycle is used,
+    //rounded up to a whole number of k-cycles, and reported to the host as latency.
+    void setRenderAhead (int samples);
+
+    int getNumRenderAheadUnderruns() const
+    {
+        return renderAheadUnderruns;
+    }
+
     MidiKeyboardState keyboardState;
 
     //==================================================================================
+    //Csound writes each display's points from the performance thread, the editor
+    //reads them on the message thread. They are passed through a triple buffer,
+    //so neither side locks and the audio side never allocates.
     class SignalDisplay
     {
     public:
         float yScale;
-        int windid, min , max, size;
+        uintptr_t windid;
+        int min , max, size;
         String caption;
 
-        SignalDisplay (String _caption, int _id, float _scale, int _min, int _max, int _size):
+        SignalDisplay (String _caption, uintptr_t _id, float _scale, int _min, int _max, int _size):
             yScale (_scale),
             windid (_id),
             min (_min),
             max (_max),
             size (_size),
             caption (_caption)
-        {}
-
-        ~SignalDisplay()
         {
-            points.clear();
+            points.setSize (size);
         }
 
-        Array<float, CriticalSection> getPoints()
+        ~SignalDisplay() {}
+
+        //returns false, leaving dest untouched, if nothing new has been drawn since the last call
+        bool getPoints (Array<float>& dest)
         {
-            return points;
+            if (points.getSize() == 0 || points.acquire() == false)
+                return false;
+
+            dest.clearQuick();
+            dest.addArray (points.getReadBuffer(), points.getSize());
+            return true;
         }
 
-        void setPoints (Array <float, CriticalSection > tablePoints)
+        void setPoints (const MYFLT* data, int numPoints)
         {
-            points.swapWith (tablePoints);
+            float* const dest = points.getWriteBuffer();
+            const int numToCopy = jmin (numPoints, points.getSize());
+
+            for (int i = 0; i < numToCopy; i++)
+                dest[i] = float (data[i]);
+
+            points.publish();
         }
 
     private:
-        Array <float, CriticalSection > points;
-    };
-
-    bool shouldUpdateSignalDisplay()
-    {
-        bool returnVal = updateSignalDisplay;
-        updateSignalDisplay = false;
-        return returnVal;
+        CabbageSnapshotBuffer<float> points;
     };
 
-    OwnedArray<MatrixEventSequencer> matrixEventSequencers;
+    //only changed on the message thread with matrixEventSequencerLock held, the audio thread skips them if it can't get it
+    OwnedArray<CabbageMatrixEventSequencer> matrixEventSequencers;
+    CriticalSection matrixEventSequencerLock;
     OwnedArray <SignalDisplay, CriticalSection> signalArrays;   //holds values from FFT function table created using dispfft
-    CsoundPluginProcessor::SignalDisplay* getSignalArray (String variableName, String displayType = "");
+    CsoundPluginProcessor::SignalDisplay* getSignalArray (const String& variableName, const String& displayType = "");
 
 private:
     //==============================================================================
-    MidiBuffer midiOutputBuffer;
+    bool performCsoundKsmps (int samplePos);
+    void writeInputToCsound (float** audioBuffers, int numChannels, int startSample, int numSamples);
+    void readOutputFromCsound (float** audioBuffers, int numChannels, int startSample, int numSamples);
+    void disableAlignedProcessing();
+    static void resolvePolledChannels (Csound& target, const StringArray& channelNames, Array<MYFLT*>& channelPointers);
+    void updatePolledChannelSnapshot();
+    bool fetchHostPosition (AudioPlayHead::CurrentPositionInfo& info);
+    void publishHostPosition (const AudioPlayHead::CurrentPositionInfo& info);
+    void initCsoundChannels (ValueTree cabbageData, Csound& target, const File& filePath);
+    void registerSignalDisplay (CSOUND* instance, const WINDAT* windat);
+    HashMap<uint64, SignalDisplay*>& getSignalDisplaysByWindow (CSOUND* instance);
+    static String getSignalVariableFromCaption (const String& caption);
+    static void resolveHostChannels (Csound& target, MYFLT** channelPointers);
+
+    CabbageMidiFifo midiOutputFifo;
 
     int guiCycles = 0;
     int guiRefreshRate = 128;
-    MidiBuffer midiBuffer;
+    CabbageMidiFifo midiInputFifo;
+    //the windid and name maps are filled from Csound's graph callbacks and read
+    //from the editor, all of them with signalArrays' lock held
+    HashMap<uint64, SignalDisplay*> signalDisplaysByWindow;
+    //a hot reload's instance registers here until installCsound() swaps it in
+    HashMap<uint64, SignalDisplay*> pendingSignalDisplaysByWindow;
+    CSOUND* pendingSignalDisplayCsound = nullptr;
+    HashMap<String, SignalDisplay*, DefaultHashFunctions, SpinLock> waveformDisplaysByName, fftDisplaysByName;
+    int midiSliceEnd = 0;
     String csoundOutput;
     std::unique_ptr<CSOUND_PARAMS> csoundParams;
     int csCompileResult = -1;
-    int numCsoundChannels, pos;
-    bool updateSignalDisplay = false;
+    int numCsoundChannels;
     MYFLT cs_scale;
     bool testLogicForMono = true;
     MYFLT* CSspin, *CSspout;
     int samplingRate = 44100;
     int csndIndex;
     int csdKsmps;
+    int hostBlockSize = 0;
+    bool alignedProcessing = false;
+    std::atomic<bool> latencyChanged { false };
+    StringArray polledChannelNames;
+    Array<MYFLT*> polledChannelPointers;
+    CabbageSnapshotBuffer<MYFLT> polledChannelSnapshot;
+    SpinLock polledChannelLock;
+    enum HostChannel
+    {
+        hostBpmChannel = 0,
+        timeInSecondsChannel,
+        isPlayingChannel,
+        isRecordingChannel,
+        hostPpqPosChannel,
+        timeInSamplesChannel,
+        timeSigDenomChannel,
+        timeSigNumChannel,
+        midiInOverflowChannel,
+        midiOutOverflowChannel,
+        numHostChannels
+    };
+    MYFLT* hostChannelPointers[numHostChannels] = {};
+    MYFLT hostChannelValues[numHostChannels];
+    bool hostInfoIsValid = false;
+    bool interpolateHostPosition = false;
+    //the last valid position processBlock() got, for setting up instances off the audio thread
+    CabbageSnapshotBuffer<AudioPlayHead::CurrentPositionInfo> hostPositionSnapshot;
+    bool hasHostPositionSnapshot = false;
     File csdFile , csdFilePath;
+    std::shared_ptr<const CsdDocument> csdDocument;
+    bool csdCompiledFromMemory = false;
     std::unique_ptr<Csound> csound;
     std::unique_ptr<FileLogger> fileLogger;
+    File pendingLoggerFile; //asked for off the message thread, guarded by backgroundCompileLock
     int busIndex = 0;
     bool disableLogging = false;
 
+    //held by processBlock() for the whole block, and briefly by installCsound() and the
+    //render ahead switch over. Nothing that waits on a thread is done with it held
+    CriticalSection csoundSwapLock;
+
+    //the instance a hot reload replaced, performed alongside the new one until it has faded out
+    struct RetiringCsound
+    {
+        std::unique_ptr<Csound> csound;
+        MYFLT* spin = nullptr;
+        MYFLT* spout = nullptr;
+        MYFLT scale = 1;
+        int ksmps = 0, numChannels = 0, index = 0;
+        int fadeLength = 0, fadeSamplesLeft = 0;
+    };
+
+    enum RetiringCsoundState
+    {
+        retiringNone = 0,
+        retiringFading,
+        retiringDone
+    };
+
+    void crossfadeRetiringCsound (AudioSampleBuffer& buffer, int numChannels);
+
+    static constexpr double crossfadeSeconds = 0.05;
+    RetiringCsound retiringCsound;
+    std::atomic<int> retiringCsoundState { retiringNone };
+    AudioSampleBuffer crossfadeBuffer;
+
+    //==============================================================================
+    //render ahead mode, processBlock() only moves audio and MIDI in and out of the
+    //queues below, everything else happens on renderAheadThread
+    void processBlockRenderAhead (AudioSampleBuffer& buffer, MidiBuffer& midiMessages);
+    void applyRenderAhead();
+    void startRenderAhead();
+    void stopRenderAhead();
+    void runRenderAhead();
+    void renderAheadKsmps();
+
+    class RenderAheadThread : public Thread
+    {
+    public:
+        RenderAheadThread (CsoundPluginProcessor& p) : Thread ("Csound render ahead"), owner (p) {}
+        void run() override { owner.runRenderAhead(); }
+
+    private:
+        CsoundPluginProcessor& owner;
+    };
+
+    //what the host told us about each block, the render thread uses it for the k-cycles that start in it
+    struct RenderAheadBlock
+    {
+        int64 startSample = 0;
+        int numSamples = 0;
+        bool hostInfoIsValid = false;
+        AudioPlayHead::CurrentPositionInfo hostInfo;
+    };
+
+    //larger sysex messages are dropped, and counted as MIDI input overflow
+    static constexpr int renderAheadMaxMidiBytes = 256;
+
+    struct RenderAheadMidiEvent
+    {
+        int64 time = 0;
+        int numBytes = 0;
+        uint8 data[renderAheadMaxMidiBytes];
+    };
+
+    int renderAheadRequested = 0;
+    int renderAheadDepth = 0;
+    std::atomic<bool> renderAheadActive { false };
+    std::atomic<int> renderAheadUnderruns { 0 };
+    std::atomic<int> renderAheadMidiDropped { 0 };
+    //audio thread, positive is output to throw away, negative is silence owed to the host
+    int64 renderAheadHostPosition = 0;
+    int renderAheadOutputOffset = 0;
+    //render thread
+    int64 renderAheadRenderPosition = 0;
+    RenderAheadBlock renderAheadCurrentBlock;
+    AudioSampleBuffer renderAheadScratch;
+    CabbageAudioFifo renderAheadInput, renderAheadOutput;
+    CabbageLockFreeQueue<RenderAheadBlock> renderAheadBlocks;
+    CabbageLockFreeQueue<RenderAheadMidiEvent> renderAheadMidiInput, renderAheadMidiOutput;
+    RenderAheadThread renderAheadThread { *this };
+
+    CriticalSection backgroundCompileLock;
+    std::unique_ptr<CompiledCsound> backgroundCompileResult;
+    std::atomic<bool> backgroundCompileInProgress { false };
+    //last, so it is stopped before anything its jobs write to goes away. Only created
+    //for the first background compile, most instances never reload
+    std::unique_ptr<ThreadPool> backgroundCompilePool;
+
 
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CsoundPluginProcessor)
@@ -177,6 +177,7 @@ public SettableTooltipClient
 //==============================================================================
 struct GraphEditorPanel::FilterComponent   : public Component,
 public Timer,
+public TooltipClient,
 private AudioProcessorParameter::Listener
 {
     FilterComponent (GraphEditorPanel& p, AudioProcessorGraph::NodeID id)  : panel (p), graph (p.graph), pluginID (id)
@@ -422,6 +423,19 @@ private AudioProcessorParameter::Listener
         }
     }
     
+    //shown in the status bar, so the cost of each node can be watched while the graph plays
+    String getTooltip() override
+    {
+        if (! graph.graph.isRenderingInParallel())
+            return {};
+        
+        const auto timing = graph.graph.getNodeTiming (pluginID);
+        
+        return "Render time: " + String (timing.lastMs, 3) + "ms (average " + String (timing.averageMs, 3)
+             + "ms, peak " + String (timing.peakMs, 3) + "ms) on thread " + String (timing.lastThread)
+             + " - whole graph " + String (graph.graph.getAverageBlockMs(), 3) + "ms per block";
+    }
+    
     AudioProcessor* getProcessor() const
     {
         if (auto node = graph.graph.getNodeForId (pluginID))
@@ -0,0 +1,786 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../Audio/Plugins/CabbagePluginProcessor.h"
+#include "../Widgets/CabbageWidgetData.h"
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+//==============================================================================
+// CabbageBench times every stage a csd goes through in a host, for each example
+// in the Examples directory, and writes the results as JSON so that runs can be
+// compared over time:
+//
+//   parseMs         CabbagePluginProcessor::parseCsdFile() over the csd, best of --repeats
+//   compileMs       Csound compiling the csd, without any of Cabbage's preprocessing
+//   loadMs          constructing a CabbagePluginProcessor, the first time the file is seen
+//   cachedLoadMs    constructing a second one, which comes from the instrument cache
+//   editorMs        createEditor(), which builds the interface with createEditorInterface()
+//   blocks          steady state processBlock() cost at each of --blocksizes
+//
+// Four suite wide sections follow the examples:
+//
+//   parser          the widget parser over every line of the corpus
+//   ioBridge        the Csound I/O bridge on its own, the old per-sample loop
+//                   against the current ksmps sized runs
+//   session         --session instances of the first example that compiled
+//   stress          --stress instances on their own threads, checking that none
+//                   sees another's audio or identchannel data. It runs once at
+//                   --samplerate, once at a second rate so the instances
+//                   recompile, and once more after a hot reload
+//
+// The exit code is 1 if the stress test finds cross-talk, or the two bridges disagree.
+//
+//   CabbageBench [--examples=dir] [--filter=text] [--output=results.json]
+//                [--blocksizes=32,64,100,256,1024] [--blocks=1000] [--warmup=100]
+//                [--repeats=5] [--samplerate=44100] [--session=40] [--stress=8]
+//                [--no-editor]
+//==============================================================================
+struct BenchSettings
+{
+    File examplesDir, outputFile;
+    String filter;
+    Array<int> blockSizes { 32, 64, 100, 256, 1024 };
+    int numBlocks = 1000, numWarmupBlocks = 100, numRepeats = 5;
+    int numSessionInstances = 40, numStressInstances = 8;
+    double sampleRate = 44100;
+    bool timeEditors = true;
+};
+
+static double msSince (int64 startTicks)
+{
+    return Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks) * 1000.0;
+}
+
+//rounded so the JSON stays readable
+static var toVar (double value, int decimalPlaces = 4)
+{
+    const double scale = std::pow (10.0, decimalPlaces);
+    return std::round (value * scale) / scale;
+}
+
+static var summarise (std::vector<double> times)
+{
+    DynamicObject::Ptr result = new DynamicObject();
+
+    if (times.empty())
+        return var (result.get());
+
+    std::sort (times.begin(), times.end());
+    double total = 0;
+
+    for (auto t : times)
+        total += t;
+
+    result->setProperty ("mean", toVar (total / times.size()));
+    result->setProperty ("median", toVar (times[times.size() / 2]));
+    result->setProperty ("p99", toVar (times[jmin (times.size() - 1, (size_t) (times.size() * 0.99))]));
+    result->setProperty ("max", toVar (times.back()));
+    return var (result.get());
+}
+
+static int getNumChannels (const File& csdFile)
+{
+    return jmax (1, CsdDocument::load (csdFile)->getNumChannels());
+}
+
+//==============================================================================
+class CabbageBench
+{
+public:
+    CabbageBench (const BenchSettings& s) : settings (s) {}
+
+    var run()
+    {
+        Array<File> examples;
+        settings.examplesDir.findChildFiles (examples, File::findFiles, true, "*.csd");
+        examples.sort();
+
+        DynamicObject::Ptr results = new DynamicObject();
+        results->setProperty ("date", Time::getCurrentTime().toISO8601 (true));
+        results->setProperty ("cpu", SystemStats::getCpuModel());
+        results->setProperty ("numCpus", SystemStats::getNumCpus());
+        results->setProperty ("os", SystemStats::getOperatingSystemName());
+        results->setProperty ("juce", SystemStats::getJUCEVersion());
+        results->setProperty ("csound", csoundGetVersion());
+        results->setProperty ("sampleRate", settings.sampleRate);
+
+        Array<var> blockSizes, exampleResults;
+
+        for (auto blockSize : settings.blockSizes)
+            blockSizes.add (blockSize);
+
+        results->setProperty ("blockSizes", blockSizes);
+
+        for (auto& csdFile : examples)
+        {
+            const String name = csdFile.getRelativePathFrom (settings.examplesDir).replaceCharacter ('\\', '/');
+
+            if (settings.filter.isNotEmpty() && ! name.containsIgnoreCase (settings.filter))
+                continue;
+
+            std::cerr << name << std::endl;
+            exampleResults.add (benchmarkExample (csdFile, name));
+            corpus.add (csdFile);
+        }
+
+        results->setProperty ("examples", exampleResults);
+        results->setProperty ("parser", benchmarkParser());
+        results->setProperty ("ioBridge", benchmarkIOBridge());
+
+        if (sessionFile != File() && settings.numSessionInstances > 0)
+            results->setProperty ("session", benchmarkSession (sessionFile));
+
+        if (settings.numStressInstances > 0)
+            results->setProperty ("stress", runStressTest());
+
+        return var (results.get());
+    }
+
+    bool stressTestPassed = true, ioBridgesAgree = true;
+
+private:
+    //==============================================================================
+    var benchmarkExample (const File& csdFile, const String& name)
+    {
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty ("name", name);
+
+        const int numChannels = getNumChannels (csdFile);
+        result->setProperty ("channels", numChannels);
+
+        //Csound on its own, straight from the file
+        {
+            CsoundPluginProcessor csound (csdFile, numChannels, numChannels);
+            const int64 start = Time::getHighResolutionTicks();
+            const bool compiled = csound.setupAndCompileCsound (csdFile, csdFile.getParentDirectory(), (int) settings.sampleRate);
+            result->setProperty ("compileMs", toVar (msSince (start)));
+            result->setProperty ("compiledWithoutCabbage", compiled);
+        }
+
+        int64 start = Time::getHighResolutionTicks();
+        std::unique_ptr<CabbagePluginProcessor> processor (new CabbagePluginProcessor (csdFile, numChannels, numChannels));
+        result->setProperty ("loadMs", toVar (msSince (start)));
+        result->setProperty ("compiled", processor->csdCompiledWithoutError());
+
+        if (processor->csdCompiledWithoutError())
+        {
+            start = Time::getHighResolutionTicks();
+            std::unique_ptr<CabbagePluginProcessor> cached (new CabbagePluginProcessor (csdFile, numChannels, numChannels));
+            result->setProperty ("cachedLoadMs", toVar (msSince (start)));
+            cached.reset();
+
+            if (sessionFile == File())
+                sessionFile = csdFile;
+
+            processor->setNonRealtime (true);
+            processor->setRateAndBufferSizeDetails (settings.sampleRate, settings.blockSizes.getFirst());
+            processor->prepareToPlay (settings.sampleRate, settings.blockSizes.getFirst());
+
+            if (settings.timeEditors)
+            {
+                start = Time::getHighResolutionTicks();
+                std::unique_ptr<AudioProcessorEditor> editor (processor->createEditor());
+                result->setProperty ("editorMs", toVar (msSince (start)));
+                editor.reset();
+            }
+
+            DynamicObject::Ptr blocks = new DynamicObject();
+
+            for (auto blockSize : settings.blockSizes)
+                blocks->setProperty (String (blockSize), benchmarkProcessBlock (*processor, blockSize));
+
+            result->setProperty ("blocks", var (blocks.get()));
+        }
+        else
+        {
+            result->setProperty ("error", processor->getCsoundOutput().trim().fromLastOccurrenceOf ("\n", false, false));
+        }
+
+        //last, as it rebuilds the processor's widget tree
+        result->setProperty ("parseMs", toVar (timeParse (*processor, csdFile)));
+        processor->releaseResources();
+        return var (result.get());
+    }
+
+    double timeParse (CabbagePluginProcessor& processor, const File& csdFile)
+    {
+        const StringArray linesFromCsd (CsdDocument::load (csdFile)->getLines());
+        double best = std::numeric_limits<double>::max();
+
+        for (int i = 0; i < settings.numRepeats; ++i)
+        {
+            StringArray lines (linesFromCsd);
+            const int64 start = Time::getHighResolutionTicks();
+            processor.parseCsdFile (lines);
+            best = jmin (best, msSince (start));
+        }
+
+        return best;
+    }
+
+    //synths are sent a chord at the start so they have something to play
+    var benchmarkProcessBlock (CabbagePluginProcessor& processor, int blockSize)
+    {
+        processor.setRateAndBufferSizeDetails (settings.sampleRate, blockSize);
+        processor.prepareToPlay (settings.sampleRate, blockSize);
+
+        AudioBuffer<float> buffer (jmax (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels()), blockSize);
+        MidiBuffer midiMessages;
+        std::vector<double> times;
+        times.reserve ((size_t) settings.numBlocks);
+
+        for (int i = 0; i < settings.numWarmupBlocks + settings.numBlocks; ++i)
+        {
+            buffer.clear();
+            midiMessages.clear();
+
+            if (i == 0)
+                for (int note : { 60, 64, 67 })
+                    midiMessages.addEvent (MidiMessage::noteOn (1, note, (uint8) 100), 0);
+
+            const int64 start = Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midiMessages);
+
+            if (i >= settings.numWarmupBlocks)
+                times.push_back (msSince (start) * 1000.0);
+        }
+
+        //channel and GUI updates queued by the blocks above, kept out of the timings
+        MessageManager::getInstance()->runDispatchLoopUntil (1);
+
+        var result = summarise (times);
+        const double blockDurationUs = blockSize * 1000000.0 / settings.sampleRate;
+        result.getDynamicObject()->setProperty ("cpuPercent", toVar (100.0 * result["mean"].operator double() / blockDurationUs, 2));
+        return result;
+    }
+
+    //==============================================================================
+    // The widget parser on its own, over every line of every csd benchmarked.
+    var benchmarkParser()
+    {
+        StringArray lines;
+
+        for (auto& csdFile : corpus)
+            lines.addArray (CsdDocument::load (csdFile)->getLines());
+
+        double best = std::numeric_limits<double>::max();
+
+        for (int i = 0; i < settings.numRepeats; ++i)
+        {
+            const int64 start = Time::getHighResolutionTicks();
+
+            for (auto& line : lines)
+            {
+                ValueTree widget ("temp");
+                CabbageWidgetData::setWidgetState (widget, line, 0);
+            }
+
+            best = jmin (best, msSince (start));
+        }
+
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty ("files", corpus.size());
+        result->setProperty ("lines", lines.size());
+        result->setProperty ("totalMs", toVar (best));
+        result->setProperty ("nsPerLine", toVar (lines.size() > 0 ? best * 1000000.0 / lines.size() : 0.0, 1));
+        return var (result.get());
+    }
+
+    //==============================================================================
+    // The copy between the host buffer and Csound's spin/spout, without Csound.
+    // Each k-boundary passes spin straight through to spout, so both versions
+    // must leave the same samples in the host buffer.
+    struct IOBridge
+    {
+        IOBridge (int k, int channels) : ksmps (k), numChannels (channels),
+            spin ((size_t) (k * channels)), spout ((size_t) (k * channels)) {}
+
+        void performKsmps()
+        {
+            std::copy (spin.begin(), spin.end(), spout.begin());
+            index = 0;
+        }
+
+        //the loop processBlock() ran before the bridge copied whole runs
+        void processPerSample (AudioBuffer<float>& buffer)
+        {
+            float** audioBuffers = buffer.getArrayOfWritePointers();
+
+            for (int i = 0; i < buffer.getNumSamples(); ++i, ++index)
+            {
+                if (index == ksmps)
+                    performKsmps();
+
+                int pos = index * numChannels;
+
+                for (int channel = 0; channel < numChannels; ++channel, ++pos)
+                {
+                    spin[(size_t) pos] = audioBuffers[channel][i] * scale;
+                    audioBuffers[channel][i] = float (spout[(size_t) pos] / scale);
+                }
+            }
+        }
+
+        //as CsoundPluginProcessor::writeInputToCsound() and readOutputFromCsound() do it
+        void processRuns (AudioBuffer<float>& buffer)
+        {
+            float** audioBuffers = buffer.getArrayOfWritePointers();
+            int samplePos = 0;
+
+            while (samplePos < buffer.getNumSamples())
+            {
+                if (index == ksmps)
+                    performKsmps();
+
+                const int numSamples = jmin (ksmps - index, buffer.getNumSamples() - samplePos);
+                MYFLT* in = spin.data() + index * numChannels;
+                const MYFLT* out = spout.data() + index * numChannels;
+
+                if (numChannels == 2)
+                {
+                    CabbageInterleave::interleavePair (in, audioBuffers[0] + samplePos, audioBuffers[1] + samplePos, numSamples, scale);
+                    CabbageInterleave::deinterleavePair (audioBuffers[0] + samplePos, audioBuffers[1] + samplePos, out, numSamples, 1.0 / scale);
+                }
+                else
+                {
+                    for (int channel = 0; channel < numChannels; ++channel)
+                    {
+                        CabbageInterleave::interleave (in + channel, numChannels, audioBuffers[channel] + samplePos, numSamples, scale);
+                        CabbageInterleave::deinterleave (audioBuffers[channel] + samplePos, out + channel, numChannels, numSamples, 1.0 / scale);
+                    }
+                }
+
+                index += numSamples;
+                samplePos += numSamples;
+            }
+        }
+
+        const int ksmps, numChannels;
+        //a power of two, so dividing by it and multiplying by its inverse agree exactly
+        const MYFLT scale = 32768.0;
+        std::vector<MYFLT> spin, spout;
+        int index = 0;
+    };
+
+    template <typename ProcessFunction>
+    static double timeBridge (int ksmps, int numChannels, int blockSize, int numBlocks, AudioBuffer<float>& lastBlock, ProcessFunction process)
+    {
+        IOBridge bridge (ksmps, numChannels);
+        bridge.index = ksmps;
+        AudioBuffer<float> buffer (numChannels, blockSize);
+        Random random (1);
+        double elapsedMs = 0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < blockSize; ++i)
+                    buffer.setSample (channel, i, random.nextFloat() * 2.0f - 1.0f);
+
+            const int64 start = Time::getHighResolutionTicks();
+            process (bridge, buffer);
+            elapsedMs += msSince (start);
+        }
+
+        lastBlock.makeCopyOf (buffer);
+        return elapsedMs * 1000000.0 / (double (numBlocks) * blockSize);
+    }
+
+    var benchmarkIOBridge()
+    {
+        Array<var> results;
+        const int samplesPerRun = 1 << 18;
+
+        for (int ksmps : { 16, 32, 64, 128 })
+            for (int blockSize : { 64, 100, 256, 512 })
+                for (int numChannels : { 1, 2, 4, 8 })
+                {
+                    const int numBlocks = jmax (1, samplesPerRun / blockSize);
+                    AudioBuffer<float> perSampleOutput, runsOutput;
+
+                    const double perSampleNs = timeBridge (ksmps, numChannels, blockSize, numBlocks, perSampleOutput,
+                                                           [] (IOBridge& bridge, AudioBuffer<float>& buffer) { bridge.processPerSample (buffer); });
+                    const double runsNs = timeBridge (ksmps, numChannels, blockSize, numBlocks, runsOutput,
+                                                      [] (IOBridge& bridge, AudioBuffer<float>& buffer) { bridge.processRuns (buffer); });
+
+                    bool identical = true;
+
+                    for (int channel = 0; channel < numChannels; ++channel)
+                        for (int i = 0; i < blockSize; ++i)
+                            identical = identical && perSampleOutput.getSample (channel, i) == runsOutput.getSample (channel, i);
+
+                    ioBridgesAgree = ioBridgesAgree && identical;
+
+                    DynamicObject::Ptr result = new DynamicObject();
+                    result->setProperty ("ksmps", ksmps);
+                    result->setProperty ("blockSize", blockSize);
+                    result->setProperty ("channels", numChannels);
+                    result->setProperty ("perSampleNsPerFrame", toVar (perSampleNs, 3));
+                    result->setProperty ("runsNsPerFrame", toVar (runsNs, 3));
+                    result->setProperty ("speedup", toVar (runsNs > 0 ? perSampleNs / runsNs : 0.0, 2));
+                    result->setProperty ("identical", identical);
+                    results.add (var (result.get()));
+                }
+
+        return results;
+    }
+
+    //==============================================================================
+    // A session with the same instrument loaded many times over, all alive at once.
+    var benchmarkSession (const File& csdFile)
+    {
+        const int numChannels = getNumChannels (csdFile);
+        OwnedArray<CabbagePluginProcessor> instances;
+        std::vector<double> times;
+        const int64 sessionStart = Time::getHighResolutionTicks();
+
+        for (int i = 0; i < settings.numSessionInstances; ++i)
+        {
+            const int64 start = Time::getHighResolutionTicks();
+            instances.add (new CabbagePluginProcessor (csdFile, numChannels, numChannels));
+            times.push_back (msSince (start));
+        }
+
+        const double totalMs = msSince (sessionStart);
+        instances.clear();
+
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty ("name", csdFile.getRelativePathFrom (settings.examplesDir).replaceCharacter ('\\', '/'));
+        result->setProperty ("instances", settings.numSessionInstances);
+        result->setProperty ("totalMs", toVar (totalMs));
+        result->setProperty ("loadMs", summarise (times));
+        return var (result.get());
+    }
+
+    //==============================================================================
+    // Each instance outputs its own constant level and keeps writing its own
+    // text to a label's identchannel. The instances run on separate threads,
+    // which also read their channel data the way an editor timer would, while
+    // the message thread does the same through the processors' async updates.
+    class StressThread  : public Thread
+    {
+    public:
+        StressThread (CabbagePluginProcessor& p, float expectedLevel, int blocks)
+            : Thread ("Stress test"), processor (p), level (expectedLevel), numBlocks (blocks) {}
+
+        void run() override
+        {
+            const int blockSize = 256;
+            AudioBuffer<float> buffer (jmax (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels()), blockSize);
+            MidiBuffer midiMessages;
+
+            for (int block = 0; block < numBlocks && ! threadShouldExit(); ++block)
+            {
+                buffer.clear();
+                processor.processBlock (buffer, midiMessages);
+
+                //the first few blocks are allowed to hold latency and start up silence
+                if (block >= 8)
+                    for (int channel = 0; channel < processor.getTotalNumOutputChannels(); ++channel)
+                        for (int i = 0; i < blockSize; ++i)
+                            if (std::abs (buffer.getSample (channel, i) - level) > 1.0e-5f)
+                                ++outputMismatches;
+
+                if (block % 4 == 0)
+                    processor.getChannelDataFromCsound();
+            }
+        }
+
+        CabbagePluginProcessor& processor;
+        const float level;
+        const int numBlocks;
+        int outputMismatches = 0;
+    };
+
+    static String createStressCsd (int instance)
+    {
+        StringArray csd;
+        csd.add ("<Cabbage>");
+        csd.add ("form size(200, 60), caption(\"Stress " + String (instance) + "\")");
+        csd.add ("label bounds(0, 0, 200, 20), text(\"\"), identchannel(\"ident\")");
+        csd.add ("</Cabbage>");
+        csd.add ("<CsoundSynthesizer>");
+        csd.add ("<CsOptions>");
+        csd.add ("-n -d -+rtmidi=NULL -M0");
+        csd.add ("</CsOptions>");
+        csd.add ("<CsInstruments>");
+        csd.add ("ksmps = 32");
+        csd.add ("nchnls = 2");
+        csd.add ("0dbfs = 1");
+        csd.add ("instr 1");
+        csd.add ("kLevel init " + String (getStressLevel (instance), 4));
+        csd.add ("if metro(50) == 1 then");
+        csd.add ("    chnset \"text(\\\"instance " + String (instance) + "\\\")\", \"ident\"");
+        csd.add ("endif");
+        csd.add ("aLevel = a(kLevel)");
+        csd.add ("outs aLevel, aLevel");
+        csd.add ("endin");
+        csd.add ("</CsInstruments>");
+        csd.add ("<CsScore>");
+        csd.add ("i1 0 z");
+        csd.add ("</CsScore>");
+        csd.add ("</CsoundSynthesizer>");
+        return csd.joinIntoString ("\n");
+    }
+
+    static float getStressLevel (int instance)      { return 0.01f * (instance + 1); }
+
+    //the instances are compiled at 44100, a pass at any other rate has them recompile in
+    //prepareToPlay(), and the last pass hot reloads them, so channel lookups that don't
+    //survive a new Csound instance show up as ident mismatches
+    var runStressTest()
+    {
+        const double otherRate = (settings.sampleRate != 48000 ? 48000 : 44100);
+        Array<var> passes;
+
+        passes.add (runStressPass (settings.sampleRate, false));
+        passes.add (runStressPass (otherRate, false));
+        passes.add (runStressPass (otherRate, true));
+
+        stressTestPassed = true;
+
+        for (auto& pass : passes)
+            stressTestPassed = stressTestPassed && (bool) pass["passed"];
+
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty ("passes", passes);
+        result->setProperty ("passed", stressTestPassed);
+        return var (result.get());
+    }
+
+    //empties the label the instrument writes to, so only reads made after this can fill it
+    static void resetIdentWidgets (CabbagePluginProcessor& processor)
+    {
+        ValueTree widgets = processor.cabbageWidgets;
+
+        for (int child = 0; child < widgets.getNumChildren(); ++child)
+        {
+            ValueTree widget = widgets.getChild (child);
+
+            if (CabbageWidgetData::getStringProp (widget, CabbageIdentifierIds::identchannel) == "ident")
+            {
+                CabbageWidgetData::setProperty (widget, CabbageIdentifierIds::text, "");
+                CabbageWidgetData::setProperty (widget, CabbageIdentifierIds::identchannelmessage, "");
+            }
+        }
+    }
+
+    var runStressPass (double sampleRate, bool reload)
+    {
+        const int numInstances = settings.numStressInstances;
+        const int numBlocks = 2000;
+        OwnedArray<TemporaryFile> csdFiles;
+        OwnedArray<CabbagePluginProcessor> instances;
+        OwnedArray<StressThread> threads;
+        int setupFailures = 0;
+
+        for (int i = 0; i < numInstances; ++i)
+        {
+            TemporaryFile* csdFile = csdFiles.add (new TemporaryFile (".csd"));
+            csdFile->getFile().replaceWithText (createStressCsd (i));
+
+            CabbagePluginProcessor* processor = instances.add (new CabbagePluginProcessor (csdFile->getFile(), 2, 2));
+
+            if (! processor->csdCompiledWithoutError())
+            {
+                ++setupFailures;
+                continue;
+            }
+
+            processor->setNonRealtime (true);
+            processor->setRateAndBufferSizeDetails (sampleRate, 256);
+            processor->prepareToPlay (sampleRate, 256);
+
+            if (reload)
+            {
+                processor->reloadCsound();
+
+                while (processor->isCompilingInBackground())
+                    MessageManager::getInstance()->runDispatchLoopUntil (5);
+            }
+
+            //anything queued by setting up is handled before the label is emptied
+            MessageManager::getInstance()->runDispatchLoopUntil (1);
+            resetIdentWidgets (*processor);
+            threads.add (new StressThread (*processor, getStressLevel (i), numBlocks));
+        }
+
+        const int64 start = Time::getHighResolutionTicks();
+
+        for (auto* thread : threads)
+            thread->startThread();
+
+        for (auto* thread : threads)
+            while (thread->isThreadRunning())
+                MessageManager::getInstance()->runDispatchLoopUntil (5);
+
+        const double wallMs = msSince (start);
+        int outputMismatches = 0, identMismatches = 0;
+
+        for (auto* thread : threads)
+            outputMismatches += thread->outputMismatches;
+
+        for (int i = 0; i < instances.size(); ++i)
+        {
+            if (! instances[i]->csdCompiledWithoutError())
+                continue;
+
+            instances[i]->getChannelDataFromCsound();
+            const ValueTree widgets = instances[i]->cabbageWidgets;
+
+            for (int child = 0; child < widgets.getNumChildren(); ++child)
+            {
+                const ValueTree widget = widgets.getChild (child);
+
+                if (CabbageWidgetData::getStringProp (widget, CabbageIdentifierIds::identchannel) == "ident"
+                    && CabbageWidgetData::getStringProp (widget, CabbageIdentifierIds::text) != "instance " + String (i))
+                    ++identMismatches;
+            }
+        }
+
+        threads.clear();
+
+        for (auto* processor : instances)
+            processor->releaseResources();
+
+        instances.clear();
+
+        DynamicObject::Ptr result = new DynamicObject();
+        result->setProperty ("sampleRate", sampleRate);
+        result->setProperty ("reloaded", reload);
+        result->setProperty ("instances", numInstances);
+        result->setProperty ("blocksPerInstance", numBlocks);
+        result->setProperty ("wallMs", toVar (wallMs));
+        result->setProperty ("setupFailures", setupFailures);
+        result->setProperty ("outputMismatches", outputMismatches);
+        result->setProperty ("identMismatches", identMismatches);
+        result->setProperty ("passed", setupFailures == 0 && outputMismatches == 0 && identMismatches == 0);
+        return var (result.get());
+    }
+
+    //==============================================================================
+    const BenchSettings settings;
+    Array<File> corpus;
+    File sessionFile;
+};
+
+//==============================================================================
+static File findExamplesDirectory()
+{
+    //run from the repository, or from anywhere in a build folder inside it
+    for (File dir = File::getCurrentWorkingDirectory(); dir.getParentDirectory() != dir; dir = dir.getParentDirectory())
+        if (dir.getChildFile ("Examples").isDirectory())
+            return dir.getChildFile ("Examples");
+
+    for (File dir = File::getSpecialLocation (File::currentExecutableFile); dir.getParentDirectory() != dir; dir = dir.getParentDirectory())
+        if (dir.getChildFile ("Examples").isDirectory())
+            return dir.getChildFile ("Examples");
+
+    return {};
+}
+
+static BenchSettings parseArguments (ArgumentList& args)
+{
+    BenchSettings settings;
+
+    if (args.containsOption ("--help|-h"))
+        ConsoleApplication::fail ("usage: " + args.executableName + " [--examples=dir] [--filter=text] [--output=results.json]\n"
+                                  "       [--blocksizes=32,64,100,256,1024] [--blocks=1000] [--warmup=100] [--repeats=5]\n"
+                                  "       [--samplerate=44100] [--session=40] [--stress=8] [--no-editor]", 0);
+
+    settings.examplesDir = args.containsOption ("--examples|-e") ? args.getExistingFolderForOptionAndRemove ("--examples|-e")
+                                                                  : findExamplesDirectory();
+
+    if (! settings.examplesDir.isDirectory())
+        ConsoleApplication::fail ("Could not find the Examples directory, use --examples");
+
+    if (args.containsOption ("--output|-o"))
+        settings.outputFile = args.getFileForOptionAndRemove ("--output|-o");
+
+    if (args.containsOption ("--filter|-f"))
+        settings.filter = args.removeValueForOption ("--filter|-f");
+
+    if (args.containsOption ("--blocksizes|-b"))
+    {
+        settings.blockSizes.clear();
+
+        for (auto& size : StringArray::fromTokens (args.removeValueForOption ("--blocksizes|-b"), ",", ""))
+            if (size.getIntValue() > 0)
+                settings.blockSizes.add (size.getIntValue());
+    }
+
+    if (args.containsOption ("--blocks"))
+        settings.numBlocks = args.removeValueForOption ("--blocks").getIntValue();
+
+    if (args.containsOption ("--warmup"))
+        settings.numWarmupBlocks = args.removeValueForOption ("--warmup").getIntValue();
+
+    if (args.containsOption ("--repeats"))
+        settings.numRepeats = args.removeValueForOption ("--repeats").getIntValue();
+
+    if (args.containsOption ("--samplerate|-r"))
+        settings.sampleRate = args.removeValueForOption ("--samplerate|-r").getDoubleValue();
+
+    if (args.containsOption ("--session"))
+        settings.numSessionInstances = args.removeValueForOption ("--session").getIntValue();
+
+    if (args.containsOption ("--stress"))
+        settings.numStressInstances = args.removeValueForOption ("--stress").getIntValue();
+
+    if (args.containsOption ("--no-editor"))
+    {
+        settings.timeEditors = false;
+        args.removeOptionIfFound ("--no-editor");
+    }
+
+    if (args.size() > 0)
+        ConsoleApplication::fail ("Unknown argument " + args[0].text);
+
+    if (settings.blockSizes.isEmpty() || settings.numBlocks <= 0 || settings.numRepeats <= 0 || settings.sampleRate <= 0)
+        ConsoleApplication::fail ("Block sizes, block counts, repeats and sample rate must all be greater than 0");
+
+    settings.numWarmupBlocks = jmax (0, settings.numWarmupBlocks);
+    return settings;
+}
+
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    return ConsoleApplication::invokeCatchingFailures ([&]
+    {
+        ArgumentList args (argc, argv);
+        const BenchSettings settings (parseArguments (args));
+        CabbageBench bench (settings);
+        const String json = JSON::toString (bench.run());
+
+        if (settings.outputFile != File())
+        {
+            if (! settings.outputFile.replaceWithText (json))
+                ConsoleApplication::fail ("Could not write to " + settings.outputFile.getFullPathName());
+        }
+        else
+            std::cout << json << std::endl;
+
+        return bench.stressTestPassed && bench.ioBridgesAgree ? 0 : 1;
+    });
+}
@@ -210,6 +210,7 @@ public:
         add ("hostbpm");
         add ("hosttime");
         add ("hostplaying");
+        add ("renderahead");
         add ("hostppqpos");
         add ("source");
         add ("infobutton");
@@ -289,6 +290,7 @@ public:
         add ("arrowbackgroundcolour");
         add ("amprange_tablenumber");
         add ("textboxoutlinecolour");
+        add ("interpolatetransport");
         add ("trackeroutsideradius");
         add ("trackerinsideradius");
         add ("surrogatelinenumber");
@@ -569,6 +571,7 @@ namespace CabbageIdentifierIds
 	static const Identifier import = "import";
 	static const Identifier importfiles = "importfiles";
 	static const Identifier increment = "increment";
+	static const Identifier interpolatetransport = "interpolatetransport";
 	static const Identifier items = "items";
 	static const Identifier keypressbaseoctave = "keypressbaseoctave";
 	static const Identifier keyseparatorcolour = "keyseparatorcolour";
@@ -629,6 +632,7 @@ namespace CabbageIdentifierIds
 	static const Identifier rangey = "rangey";
 	static const Identifier readonly = "readonly";
 	static const Identifier refreshfiles = "refreshfiles";
+	static const Identifier renderahead = "renderahead";
 	static const Identifier rescale = "scale";
 	static const Identifier resize = "resize";
 	static const Identifier resizemode = "resizemode";
@@ -702,6 +706,8 @@ namespace CabbageIdentifierIds
 	static const String index = "index";
 	static const String isplaying = "IS_PLAYING";
 	static const String isrecording = "IS_RECORDING";
+	static const String midiinoverflow = "MIDI_IN_OVERFLOW";
+	static const String midioutoverflow = "MIDI_OUT_OVERFLOW";
 	static const String mousedownleft = "MOUSE_DOWN_LEFT";
 	static const String mousedownlmiddle = "MOUSE_DOWN_MIDDLE";
 	static const String mousedownright = "MOUSE_DOWN_RIGHT";
@@ -0,0 +1,405 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "../Audio/Plugins/CabbagePluginProcessor.h"
+#include "../Widgets/CabbageWidgetData.h"
+#include <iostream>
+
+//==============================================================================
+// Renders a csd through CabbagePluginProcessor, the same way a plugin host
+// would, without a GUI or an audio device. The processor is driven from a
+// render thread while the main thread runs the message loop, so widget, channel
+// and async updates all happen as they would in a host, only faster than real
+// time.
+//
+//   CabbageRender instrument.csd --output=out.wav [--input=in.wav] [--midi=in.mid]
+//                 [--automation=moves.txt] [--duration=secs] [--tail=secs]
+//                 [--samplerate=44100] [--blocksize=512] [--bits=24] [--bpm=120]
+//
+// Automation files hold one "<seconds> <channel> <value>" per line, # starts a
+// comment. Values are applied at the start of the block they fall in, through
+// the channel's plugin parameter if it has one, or straight to Csound if not.
+//==============================================================================
+struct RenderSettings
+{
+    File csdFile, outputFile, inputFile, midiFile, automationFile;
+    double sampleRate = 44100, duration = 0, tail = 0, bpm = 120;
+    int blockSize = 512, bitDepth = 24;
+};
+
+struct AutomationPoint
+{
+    double time;
+    String channel;
+    float value;
+};
+
+//==============================================================================
+// A transport that is always playing, from the start of the render.
+class OfflinePlayHead  : public AudioPlayHead
+{
+public:
+    OfflinePlayHead (double sr, double tempo) : sampleRate (sr), bpm (tempo) {}
+
+    void setPosition (int64 samplePosition)     { position = samplePosition; }
+
+    bool getCurrentPosition (CurrentPositionInfo& result) override
+    {
+        result.resetToDefault();
+        result.bpm = bpm;
+        result.timeSigNumerator = 4;
+        result.timeSigDenominator = 4;
+        result.timeInSamples = position;
+        result.timeInSeconds = position / sampleRate;
+        result.ppqPosition = result.timeInSeconds * bpm / 60.0;
+        result.isPlaying = true;
+        return true;
+    }
+
+private:
+    const double sampleRate, bpm;
+    int64 position = 0;
+};
+
+//==============================================================================
+class OfflineRenderer  : public Thread
+{
+public:
+    OfflineRenderer (const RenderSettings& s) : Thread ("Offline render"), settings (s)
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    //everything that has to happen on the message thread before rendering can start
+    void prepare()
+    {
+        if (settings.inputFile != File())
+        {
+            inputReader.reset (formatManager.createReaderFor (settings.inputFile));
+
+            if (inputReader == nullptr)
+                ConsoleApplication::fail ("Could not read " + settings.inputFile.getFullPathName());
+        }
+
+        if (settings.midiFile != File())
+        {
+            loadMidiFile();
+
+            //the processor hands MIDI to Csound through its host MIDI callbacks, which
+            //Csound only opens if the csd asks for MIDI input, as it would in a plugin
+            if (! CsdDocument::load (settings.csdFile)->getCsOptions().contains ("-M"))
+                std::cout << "Warning: " << settings.csdFile.getFileName() << " has no -M option in its <CsOptions>, "
+                          << "so Csound will not read the events in " << settings.midiFile.getFileName() << std::endl;
+        }
+
+        if (settings.automationFile != File())
+            loadAutomation();
+
+        totalSamples = int64 (settings.duration * settings.sampleRate);
+
+        if (totalSamples <= 0 && inputReader != nullptr)
+            totalSamples = inputReader->lengthInSamples;
+
+        if (totalSamples <= 0 && midiEvents.getNumEvents() > 0)
+            totalSamples = int64 (midiEvents.getEndTime() * settings.sampleRate);
+
+        if (totalSamples <= 0)
+            ConsoleApplication::fail ("Nothing to take the length of the render from, use --duration");
+
+        totalSamples += int64 (settings.tail * settings.sampleRate);
+
+        const int numChannels = CsdDocument::load (settings.csdFile)->getNumChannels();
+        const double startTime = Time::getMillisecondCounterHiRes();
+
+        processor.reset (new CabbagePluginProcessor (settings.csdFile, numChannels, numChannels));
+
+        if (! processor->csdCompiledWithoutError())
+            ConsoleApplication::fail ("Csound could not compile " + settings.csdFile.getFullPathName()
+                                      + "\n" + processor->getCsoundOutput());
+
+        playHead.reset (new OfflinePlayHead (settings.sampleRate, settings.bpm));
+        processor->setPlayHead (playHead.get());
+        processor->setNonRealtime (true);
+        processor->setRateAndBufferSizeDetails (settings.sampleRate, settings.blockSize);
+        processor->prepareToPlay (settings.sampleRate, settings.blockSize);
+        loadTimeMs = Time::getMillisecondCounterHiRes() - startTime;
+
+        for (auto& point : automation)
+        {
+            const ValueTree widget = processor->getWidgetForChannel (point.channel);
+            automationTargets.add (widget.isValid() ? processor->getParameterForWidget (CabbageWidgetData::getStringProp (widget, CabbageIdentifierIds::name))
+                                                    : nullptr);
+        }
+
+        numOutputChannels = processor->getTotalNumOutputChannels();
+        buffer.setSize (jmax (processor->getTotalNumInputChannels(), numOutputChannels), settings.blockSize);
+
+        settings.outputFile.deleteFile();
+        std::unique_ptr<FileOutputStream> stream (settings.outputFile.createOutputStream());
+
+        if (stream == nullptr)
+            ConsoleApplication::fail ("Could not write to " + settings.outputFile.getFullPathName());
+
+        WavAudioFormat wav;
+        writer.reset (wav.createWriterFor (stream.get(), settings.sampleRate, (unsigned int) numOutputChannels,
+                                           settings.bitDepth, {}, 0));
+
+        if (writer == nullptr)
+            ConsoleApplication::fail ("Can't write a " + String (settings.bitDepth) + " bit wav file");
+
+        stream.release();
+    }
+
+    void run() override
+    {
+        const double startTime = Time::getMillisecondCounterHiRes();
+        //whatever latency the processor reports is trimmed off the start, and rendered on the end
+        const int latency = processor->getLatencySamples();
+        const int64 samplesToRender = totalSamples + latency;
+        int64 position = 0;
+        int automationIndex = 0;
+        MidiBuffer midiMessages;
+
+        while (position < samplesToRender && ! threadShouldExit())
+        {
+            const int numSamples = (int) jmin ((int64) settings.blockSize, samplesToRender - position);
+            AudioBuffer<float> block (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+            block.clear();
+
+            if (inputReader != nullptr)
+                inputReader->read (&block, 0, numSamples, position, true, true);
+
+            const double blockEnd = double (position + numSamples) / settings.sampleRate;
+
+            for (; automationIndex < automation.size() && automation.getReference (automationIndex).time < blockEnd; ++automationIndex)
+            {
+                const AutomationPoint& point = automation.getReference (automationIndex);
+
+                if (CabbageAudioParameter* param = automationTargets[automationIndex])
+                    param->setValueNotifyingHost (param->range.convertTo0to1 (point.value));
+                else
+                    processor->setCabbageParameter (point.channel, point.value);
+            }
+
+            midiMessages.clear();
+            addMidiForBlock (midiMessages, position, numSamples);
+
+            playHead->setPosition (position);
+            processor->processBlock (block, midiMessages);
+
+            const int skip = (int) jlimit ((int64) 0, (int64) numSamples, latency - position);
+
+            if (skip < numSamples)
+                writer->writeFromAudioSampleBuffer (block, skip, numSamples - skip);
+
+            position += numSamples;
+            ++numBlocks;
+        }
+
+        renderTimeMs = Time::getMillisecondCounterHiRes() - startTime;
+        writer.reset();
+    }
+
+    void printSummary() const
+    {
+        const double audioSeconds = totalSamples / settings.sampleRate;
+        const double renderSeconds = renderTimeMs / 1000.0;
+
+        std::cout << "Rendered " << String (audioSeconds, 2) << "s of audio to "
+                  << settings.outputFile.getFullPathName() << std::endl
+                  << "Load and compile: " << String (loadTimeMs, 1) << "ms" << std::endl
+                  << "Render: " << String (renderSeconds, 3) << "s, " << numBlocks << " blocks of "
+                  << settings.blockSize << ", " << String (numBlocks > 0 ? renderTimeMs / numBlocks : 0.0, 4) << "ms per block" << std::endl
+                  << "Throughput: " << String (renderSeconds > 0 ? audioSeconds / renderSeconds : 0.0, 2) << "x realtime" << std::endl;
+    }
+
+    void releaseProcessor()
+    {
+        if (processor != nullptr)
+            processor->releaseResources();
+
+        processor.reset();
+    }
+
+private:
+    void loadMidiFile()
+    {
+        FileInputStream stream (settings.midiFile);
+        MidiFile midiFile;
+
+        if (stream.failedToOpen() || ! midiFile.readFrom (stream))
+            ConsoleApplication::fail ("Could not read " + settings.midiFile.getFullPathName());
+
+        midiFile.convertTimestampTicksToSeconds();
+
+        for (int track = 0; track < midiFile.getNumTracks(); ++track)
+            midiEvents.addSequence (*midiFile.getTrack (track), 0);
+
+        midiEvents.sort();
+    }
+
+    void addMidiForBlock (MidiBuffer& midiMessages, int64 position, int numSamples)
+    {
+        const double blockStart = position / settings.sampleRate;
+        const double blockEnd = (position + numSamples) / settings.sampleRate;
+
+        for (; nextMidiEvent < midiEvents.getNumEvents(); ++nextMidiEvent)
+        {
+            const MidiMessage& message = midiEvents.getEventPointer (nextMidiEvent)->message;
+
+            if (message.getTimeStamp() >= blockEnd)
+                break;
+
+            if (message.isMetaEvent())
+                continue;
+
+            const int samplePosition = (int) ((message.getTimeStamp() - blockStart) * settings.sampleRate);
+            midiMessages.addEvent (message, jlimit (0, numSamples - 1, samplePosition));
+        }
+    }
+
+    void loadAutomation()
+    {
+        StringArray lines;
+        settings.automationFile.readLines (lines);
+
+        for (auto& line : lines)
+        {
+            StringArray tokens;
+            tokens.addTokens (line.upToFirstOccurrenceOf ("#", false, false), " \t", "\"");
+            tokens.removeEmptyStrings();
+
+            if (tokens.size() == 0)
+                continue;
+
+            if (tokens.size() != 3)
+                ConsoleApplication::fail ("Bad automation line, expected <seconds> <channel> <value>: " + line);
+
+            automation.add ({ tokens[0].getDoubleValue(), tokens[1].unquoted(), tokens[2].getFloatValue() });
+        }
+
+        struct TimeOrder
+        {
+            static int compareElements (const AutomationPoint& a, const AutomationPoint& b)
+            {
+                return a.time < b.time ? -1 : (b.time < a.time ? 1 : 0);
+            }
+        } order;
+
+        automation.sort (order, true);
+    }
+
+    const RenderSettings settings;
+    AudioFormatManager formatManager;
+    std::unique_ptr<AudioFormatReader> inputReader;
+    std::unique_ptr<AudioFormatWriter> writer;
+    std::unique_ptr<CabbagePluginProcessor> processor;
+    std::unique_ptr<OfflinePlayHead> playHead;
+    MidiMessageSequence midiEvents;
+    int nextMidiEvent = 0;
+    Array<AutomationPoint> automation;
+    Array<CabbageAudioParameter*> automationTargets;
+    AudioBuffer<float> buffer;
+    int numOutputChannels = 0;
+    int64 totalSamples = 0;
+    int64 numBlocks = 0;
+    double loadTimeMs = 0, renderTimeMs = 0;
+};
+
+//==============================================================================
+static RenderSettings parseArguments (ArgumentList& args)
+{
+    RenderSettings settings;
+
+    if (args.size() == 0 || args.containsOption ("--help|-h"))
+        ConsoleApplication::fail ("usage: " + args.executableName + " instrument.csd --output=out.wav [--input=in.wav] [--midi=in.mid]\n"
+                                  "       [--automation=moves.txt] [--duration=secs] [--tail=secs] [--samplerate=44100]\n"
+                                  "       [--blocksize=512] [--bits=24] [--bpm=120]", 0);
+
+    settings.outputFile = args.getFileForOptionAndRemove ("--output|-o");
+
+    if (args.containsOption ("--input|-i"))
+        settings.inputFile = args.getExistingFileForOptionAndRemove ("--input|-i");
+
+    if (args.containsOption ("--midi|-m"))
+        settings.midiFile = args.getExistingFileForOptionAndRemove ("--midi|-m");
+
+    if (args.containsOption ("--automation|-a"))
+        settings.automationFile = args.getExistingFileForOptionAndRemove ("--automation|-a");
+
+    if (args.containsOption ("--duration|-d"))
+        settings.duration = args.removeValueForOption ("--duration|-d").getDoubleValue();
+
+    if (args.containsOption ("--tail|-t"))
+        settings.tail = args.removeValueForOption ("--tail|-t").getDoubleValue();
+
+    if (args.containsOption ("--bpm"))
+        settings.bpm = args.removeValueForOption ("--bpm").getDoubleValue();
+
+    if (args.containsOption ("--blocksize|-b"))
+        settings.blockSize = args.removeValueForOption ("--blocksize|-b").getIntValue();
+
+    if (args.containsOption ("--bits"))
+        settings.bitDepth = args.removeValueForOption ("--bits").getIntValue();
+
+    //the input file's rate is used unless one is asked for
+    if (args.containsOption ("--samplerate|-r"))
+        settings.sampleRate = args.removeValueForOption ("--samplerate|-r").getDoubleValue();
+    else if (settings.inputFile != File())
+    {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        if (std::unique_ptr<AudioFormatReader> reader { formats.createReaderFor (settings.inputFile) })
+            settings.sampleRate = reader->sampleRate;
+    }
+
+    if (args.size() != 1 || args[0].isOption())
+        ConsoleApplication::fail ("Expected a single csd file, and options as --name=value");
+
+    settings.csdFile = args[0].resolveAsExistingFile();
+
+    if (settings.blockSize <= 0 || settings.sampleRate <= 0 || settings.bpm <= 0)
+        ConsoleApplication::fail ("Block size, sample rate and bpm must all be greater than 0");
+
+    return settings;
+}
+
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    return ConsoleApplication::invokeCatchingFailures ([&]
+    {
+        ArgumentList args (argc, argv);
+        OfflineRenderer renderer (parseArguments (args));
+
+        renderer.prepare();
+        renderer.startThread();
+
+        //async updates from the processor are delivered here, as they would be in a host
+        while (renderer.isThreadRunning())
+            MessageManager::getInstance()->runDispatchLoopUntil (20);
+
+        renderer.releaseProcessor();
+        renderer.printSummary();
+        return 0;
+    });
+}
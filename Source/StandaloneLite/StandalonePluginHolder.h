@@ -123,7 +123,7 @@ public:
         processor.reset (::createPluginFilterOfType (AudioProcessor::wrapperType_Standalone));
 #else
         AudioProcessor::setTypeOfNextNewPlugin (AudioProcessor::wrapperType_Standalone);
-        const int numChannels = CabbageUtilities::getHeaderInfo(File(file).loadFileAsString(), "nchnls");
+        const int numChannels = CsdDocument::load(File(file))->getNumChannels();
         processor.reset (createCabbagePluginFilter (File (file), numChannels));
         
 
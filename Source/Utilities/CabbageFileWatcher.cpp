@@ -0,0 +1,149 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#include "CabbageFileWatcher.h"
+
+#if JUCE_LINUX
+ #include <sys/inotify.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+CabbageFileWatcher::CabbageFileWatcher (Listener& listenerToNotify)
+    : Thread ("Cabbage file watcher"),
+      listener (listenerToNotify)
+{
+}
+
+CabbageFileWatcher::~CabbageFileWatcher()
+{
+    stopWatching();
+}
+
+//==============================================================================
+void CabbageFileWatcher::startWatching (const File& fileToWatch)
+{
+    if (fileToWatch == watchedFile)
+        return;
+
+    stopWatching();
+    watchedFile = fileToWatch;
+    lastModificationTime = watchedFile.getLastModificationTime().toMilliseconds();
+
+    if (startNotifier() == false)
+        startTimer (1000);
+}
+
+void CabbageFileWatcher::stopWatching()
+{
+    stopTimer();
+    stopNotifier();
+    cancelPendingUpdate();
+    watchedFile = File();
+}
+
+//==============================================================================
+void CabbageFileWatcher::timerCallback()
+{
+    const int64 modificationTime = watchedFile.getLastModificationTime().toMilliseconds();
+
+    if (modificationTime != lastModificationTime && watchedFile.existsAsFile())
+        handleAsyncUpdate();
+}
+
+void CabbageFileWatcher::handleAsyncUpdate()
+{
+    //a save can arrive as several events, only pass on actual changes
+    const int64 modificationTime = watchedFile.getLastModificationTime().toMilliseconds();
+
+    if (modificationTime == lastModificationTime || watchedFile.existsAsFile() == false)
+        return;
+
+    lastModificationTime = modificationTime;
+    listener.watchedFileChanged (watchedFile);
+}
+
+//==============================================================================
+#if JUCE_LINUX
+
+bool CabbageFileWatcher::startNotifier()
+{
+    notifierHandle = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+    if (notifierHandle < 0)
+        return false;
+
+    watchHandle = inotify_add_watch (notifierHandle, watchedFile.getParentDirectory().getFullPathName().toRawUTF8(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+    if (watchHandle < 0)
+    {
+        close (notifierHandle);
+        notifierHandle = -1;
+        return false;
+    }
+
+    startThread (3);
+    return true;
+}
+
+void CabbageFileWatcher::stopNotifier()
+{
+    if (notifierHandle < 0)
+        return;
+
+    stopThread (2000);
+    inotify_rm_watch (notifierHandle, watchHandle);
+    close (notifierHandle);
+    notifierHandle = watchHandle = -1;
+}
+
+void CabbageFileWatcher::run()
+{
+    const String fileName = watchedFile.getFileName();
+    HeapBlock<char> eventBuffer (4096);
+    pollfd descriptor = { notifierHandle, POLLIN, 0 };
+
+    while (threadShouldExit() == false)
+    {
+        //wake up regularly to check whether we've been asked to stop
+        if (poll (&descriptor, 1, 250) <= 0)
+            continue;
+
+        const ssize_t numBytes = read (notifierHandle, eventBuffer.getData(), 4096);
+
+        for (ssize_t pos = 0; pos < numBytes;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*> (eventBuffer.getData() + pos);
+
+            if (event->len > 0 && fileName == String::fromUTF8 (event->name))
+                triggerAsyncUpdate();
+
+            pos += ssize_t (sizeof (inotify_event) + event->len);
+        }
+    }
+}
+
+#else
+
+bool CabbageFileWatcher::startNotifier()    { return false; }
+void CabbageFileWatcher::stopNotifier()     {}
+void CabbageFileWatcher::run()              {}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEFILEWATCHER_H_INCLUDED
+#define CABBAGEFILEWATCHER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Tells a listener, on the message thread, when a file has been written to. On
+// Linux the file's directory is watched with inotify, which also catches editors
+// that save by writing a new file and renaming it over the old one. Elsewhere, or
+// if inotify isn't available, the modification time is polled once a second.
+//==============================================================================
+class CabbageFileWatcher : private Thread,
+                           private Timer,
+                           private AsyncUpdater
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+        virtual void watchedFileChanged (const File& file) = 0;
+    };
+
+    CabbageFileWatcher (Listener& listenerToNotify);
+    ~CabbageFileWatcher();
+
+    void startWatching (const File& fileToWatch);
+    void stopWatching();
+    bool isWatching() const                 { return watchedFile != File(); }
+    const File& getWatchedFile() const      { return watchedFile; }
+
+private:
+    void run() override;
+    void timerCallback() override;
+    void handleAsyncUpdate() override;
+    bool startNotifier();
+    void stopNotifier();
+
+    Listener& listener;
+    File watchedFile;
+    int64 lastModificationTime = 0;
+    int notifierHandle = -1, watchHandle = -1;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageFileWatcher)
+};
+
+#endif  // CABBAGEFILEWATCHER_H_INCLUDED
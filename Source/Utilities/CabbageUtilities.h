@@ -24,6 +24,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "../BinaryData/CabbageBinaryData.h"
+#include "CsdDocument.h"
 
 #include <fstream>
 
@@ -385,42 +386,10 @@ public:
 #endif
     }
 	//==============================================================
+	//prefer CsdDocument::load() when the file is at hand, it saves parsing the text again
 	static int getHeaderInfo(String csdText, String headerString)
 	{
-
-		while (csdText.indexOf("/*") != -1 && csdText.indexOf("*/") != -1)
-		{
-			const String comments = csdText.substring(csdText.indexOf("/*"), csdText.indexOf("*/") + 2);
-			csdText = csdText.replace(comments, "");
-		}
-
-		StringArray array;
-		array.addLines(csdText);
-
-		bool inCsoundInstrumentsSection = false;
-
-		for (int i = 0; i < array.size(); i++)
-		{
-			if (array[i] == "<CsInstruments>")
-				inCsoundInstrumentsSection = true;
-
-			if (inCsoundInstrumentsSection)
-			{
-                CabbageUtilities::debug(array[i]);
-				if (array[i].indexOf(";") != -1)
-					array.set(i, array[i].substring(0, array[i].indexOf(";")));
-
-				array.set(i, array[i].removeCharacters("\t").trimStart());
-
-				if (array[i].contains(headerString) && array[i].contains("="))
-				{
-					String channels = array[i].substring(array[i].indexOf("=") + 1, (array[i].contains(";") ? array[i].indexOf(";") : 100));
-					return channels.trim().getIntValue();
-				}
-			}
-		}
-
-		return headerString=="nchnls" ? 2 : -1;
+		return CsdDocument (csdText).getHeaderValue (headerString, headerString=="nchnls" ? 2 : -1);
 	}
     //==============================================================
     static const String getSVGTextFromMemory (const void* svg, size_t size)
@@ -929,12 +898,7 @@ public:
     //==========================================================================================
     static bool hasCabbageTags (File inputFile)
     {
-        const String csdFile = inputFile.loadFileAsString();
-
-        if (csdFile.contains ("<Cabbage>") && csdFile.contains ("</Cabbage>"))
-            return true;
-        else
-            return false;
+        return CsdDocument::load (inputFile)->hasCabbageSection();
     }
 
     static String correctPathSlashes (String path)
@@ -0,0 +1,199 @@
+/*
+  Copyright (C) 2016 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#include "CsdDocument.h"
+
+CsdDocument::CsdDocument (const String& csdText)
+    : text (csdText)
+{
+    parse();
+}
+
+//==============================================================================
+std::shared_ptr<const CsdDocument> CsdDocument::load (const File& csdFile)
+{
+    struct CacheEntry
+    {
+        std::weak_ptr<const CsdDocument> document;
+        Time modificationTime;
+        int64 size;
+    };
+
+    static CriticalSection cacheLock;
+    static HashMap<String, CacheEntry> cache;
+
+    const String path = csdFile.getFullPathName();
+    const Time modificationTime = csdFile.getLastModificationTime();
+    const int64 size = csdFile.getSize();
+
+    {
+        const ScopedLock sl (cacheLock);
+
+        if (cache.contains (path))
+        {
+            const CacheEntry entry = cache[path];
+
+            if (entry.modificationTime == modificationTime && entry.size == size)
+                if (std::shared_ptr<const CsdDocument> document = entry.document.lock())
+                    return document;
+        }
+    }
+
+    std::shared_ptr<const CsdDocument> document (new CsdDocument (csdFile.loadFileAsString()));
+
+    const ScopedLock sl (cacheLock);
+
+    //documents nothing holds on to any more are dropped, so the cache only grows with the files in use
+    StringArray expiredPaths;
+
+    for (HashMap<String, CacheEntry>::Iterator i (cache); i.next();)
+        if (i.getValue().document.expired())
+            expiredPaths.add (i.getKey());
+
+    for (auto& expiredPath : expiredPaths)
+        cache.remove (expiredPath);
+
+    cache.set (path, { document, modificationTime, size });
+    return document;
+}
+
+//==============================================================================
+StringArray CsdDocument::getCabbageLines() const
+{
+    StringArray cabbageLines;
+
+    if (hasCabbageSection())
+        for (int i = cabbageStartLine + 1; i < cabbageEndLine; i++)
+            cabbageLines.add (lines[i]);
+
+    return cabbageLines;
+}
+
+int CsdDocument::getHeaderValue (const String& name, int defaultValue) const
+{
+    if (headerStatements.containsKey (name))
+        return headerStatements[name].getIntValue();
+
+    return defaultValue;
+}
+
+//==============================================================================
+void CsdDocument::parse()
+{
+    lines.addLines (text);
+    hasCsoundTags = text.contains ("<Csound") || text.contains ("</Csound");
+
+    bool beforeCabbageEnd = true, inOptions = false, inInstruments = false, inBlockComment = false;
+    int instrumentDepth = 0;
+
+    for (int i = 0; i < lines.size(); i++)
+    {
+        const String& line = lines.getReference (i);
+
+        if (beforeCabbageEnd)
+        {
+            if (line.contains ("<Cabbage>"))
+                cabbageStartLine = i;
+
+            if (line.trimStart().startsWith ("#define"))
+                macroDefinitions.add (line);
+
+            if (cabbageStartLine >= 0 && formLine.isEmpty()
+                && line.trimStart().initialSectionNotContaining (" \t") == "form")
+                formLine = line;
+
+            if (line.contains ("</Cabbage>"))
+            {
+                cabbageEndLine = i;
+                beforeCabbageEnd = false;
+            }
+        }
+
+        if (line.contains ("<CsOptions>"))
+        {
+            inOptions = true;
+            continue;
+        }
+        else if (line.contains ("</CsOptions>"))
+            inOptions = false;
+        else if (inOptions)
+            csOptions += (csOptions.isEmpty() ? "" : " ") + line.trim();
+
+        if (line.contains ("<CsInstruments>"))
+        {
+            inInstruments = true;
+            continue;
+        }
+        else if (line.contains ("</CsInstruments>"))
+            inInstruments = false;
+
+        if (inInstruments == false)
+            continue;
+
+        //strip block and line comments
+        String code;
+        int pos = 0;
+
+        while (pos < line.length())
+        {
+            if (inBlockComment)
+            {
+                const int end = line.indexOf (pos, "*/");
+
+                if (end < 0)
+                    break;
+
+                inBlockComment = false;
+                pos = end + 2;
+                continue;
+            }
+
+            const int blockStart = line.indexOf (pos, "/*");
+            const int lineComment = jmin (line.indexOf (pos, ";") < 0 ? line.length() : line.indexOf (pos, ";"),
+                                          line.indexOf (pos, "//") < 0 ? line.length() : line.indexOf (pos, "//"));
+
+            if (blockStart >= 0 && blockStart < lineComment)
+            {
+                code += line.substring (pos, blockStart);
+                inBlockComment = true;
+                pos = blockStart + 2;
+            }
+            else
+            {
+                code += line.substring (pos, lineComment);
+                break;
+            }
+        }
+
+        code = code.trim();
+        const String firstToken = code.initialSectionNotContaining (" \t");
+
+        if (firstToken == "instr" || firstToken == "opcode")
+            instrumentDepth++;
+        else if (firstToken == "endin" || firstToken == "endop")
+            instrumentDepth = jmax (0, instrumentDepth - 1);
+        else if (instrumentDepth == 0 && code.containsChar ('='))
+        {
+            const String name = code.upToFirstOccurrenceOf ("=", false, false).trim();
+
+            if (name.isNotEmpty() && headerStatements.containsKey (name) == false)
+                headerStatements.set (name, code.fromFirstOccurrenceOf ("=", false, false).trim());
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2016 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CSDDOCUMENT_H_INCLUDED
+#define CSDDOCUMENT_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// A csd file, read once and split up in a single pass. It keeps the raw lines, the
+// extent of the <Cabbage> section, the form() line, the #define lines that come
+// before </Cabbage>, the <CsOptions> text and the global header statements from
+// <CsInstruments> (sr, ksmps, nchnls, 0dbfs, ...) with comments stripped.
+//==============================================================================
+class CsdDocument
+{
+public:
+    explicit CsdDocument (const String& csdText);
+    ~CsdDocument() {}
+
+    //returns the parsed contents of a file. Documents are shared for as long as
+    //something holds on to them, and re-read when the file changes on disk.
+    static std::shared_ptr<const CsdDocument> load (const File& csdFile);
+
+    const String& getText() const                   { return text; }
+    const StringArray& getLines() const             { return lines; }
+
+    bool hasCabbageSection() const                  { return cabbageStartLine >= 0 && cabbageEndLine >= 0; }
+    bool hasCsoundSection() const                   { return hasCsoundTags; }
+    StringArray getCabbageLines() const;
+    const String& getFormLine() const               { return formLine; }
+    const StringArray& getMacroDefinitions() const  { return macroDefinitions; }
+    const String& getCsOptions() const              { return csOptions; }
+
+    //value of a global header statement such as sr or ksmps, or defaultValue if there isn't one
+    int getHeaderValue (const String& name, int defaultValue = -1) const;
+    int getNumChannels() const                      { return getHeaderValue ("nchnls", 2); }
+
+private:
+    void parse();
+
+    String text;
+    StringArray lines;
+    int cabbageStartLine = -1, cabbageEndLine = -1;
+    bool hasCsoundTags = false;
+    String formLine, csOptions;
+    StringArray macroDefinitions;
+    StringPairArray headerStatements;
+
+    JUCE_DECLARE_NON_COPYABLE (CsdDocument)
+};
+
+#endif  // CSDDOCUMENT_H_INCLUDED
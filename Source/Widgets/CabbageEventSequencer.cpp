@@ -52,7 +52,7 @@ CabbageEventSequencer::CabbageEventSequencer (ValueTree wData, CabbagePluginEdit
     }
 
 	//matrix belongs to processor..
-    owner->createEventMatrix(numColumns, numRows, getChannel());
+    owner->createEventMatrix(numColumns, numRows, getChannel(), orientation == "vertical");
     //init matrix data:
     for( int x = 0 ; x < numColumns ; x++)
         for( int y = 0 ; y < numRows ; y++)
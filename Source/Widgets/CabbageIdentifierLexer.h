@@ -0,0 +1,319 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEIDENTIFIERLEXER_H_INCLUDED
+#define CABBAGEIDENTIFIERLEXER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Single pass lexer for the identifier(args...) part of a Cabbage widget line.
+// Identifiers and arguments are handed out as ranges into the original text,
+// numbers are read straight from those ranges, and a String is only created
+// when one is asked for. Splitting follows the rules the parser has always used:
+// groups end at a ')' that is not inside quotes, the arguments are split on every
+// comma, and quote characters are dropped from argument text.
+//
+// getIdentifierHash() gives the same value as HashStringToInt() does for the
+// identifier, truncated after any ':', so callers can switch on it directly.
+//==============================================================================
+class CabbageIdentifierLexer
+{
+public:
+    typedef String::CharPointerType CharPointer;
+
+    struct Argument
+    {
+        enum Type
+        {
+            word = 0,
+            number,
+            quoted
+        };
+
+        CharPointer start, end;
+        Type type;
+
+        String toString() const
+        {
+            if (type != quoted)
+                return String (start, end);
+
+            String text;
+            text.preallocateBytes (size_t (end.getAddress() - start.getAddress()));
+
+            for (CharPointer p (start); p != end; ++p)
+                if (*p != '"')
+                    text += *p;
+
+            return text;
+        }
+
+        double getDoubleValue() const
+        {
+            if (type == quoted)
+                return toString().getDoubleValue();
+
+            return start.getDoubleValue();
+        }
+
+        int getIntValue() const
+        {
+            if (type == quoted)
+                return toString().getIntValue();
+
+            return start.getIntValue32();
+        }
+    };
+
+    //==============================================================================
+    explicit CabbageIdentifierLexer (const String& lineOfText)
+        : text (lineOfText), position (text.getCharPointer()), end (text.getCharPointer())
+    {
+        //nothing after the last closing bracket is ever looked at
+        const int lastBracket = text.lastIndexOfChar (')');
+        end = position + (lastBracket + 1);
+
+        while (position != end && (*position == ')' || *position == ',' || *position == ' '))
+            ++position;
+    }
+
+    //==============================================================================
+    // Moves on to the next identifier, returns false once the line is used up.
+    bool next()
+    {
+        while (position.getAddress() < end.getAddress())
+        {
+            CharPointer groupStart (position), groupEnd (position);
+
+            while (groupEnd != end && *groupEnd != ')')
+            {
+                if (*groupEnd == '"')
+                {
+                    ++groupEnd;
+
+                    while (groupEnd != end && *groupEnd != '"')
+                        ++groupEnd;
+
+                    if (groupEnd == end)
+                        break;
+                }
+
+                ++groupEnd;
+            }
+
+            position = groupEnd;
+
+            if (position != end)
+                ++position;
+
+            if (readGroup (groupStart, groupEnd))
+                return true;
+        }
+
+        return false;
+    }
+
+    //==============================================================================
+    uint64 getIdentifierHash() const                { return identifierHash; }
+
+    // The identifier with anything after a ':' removed, e.g. colour for colour:1
+    Identifier getIdentifier() const
+    {
+        return identifierHasSpaces ? Identifier (getFullIdentifier().upToFirstOccurrenceOf (":", true, false))
+                                   : Identifier (identifierStart, identifierShortEnd);
+    }
+
+    String getFullIdentifier() const
+    {
+        const String identifier (identifierStart, identifierEnd);
+        return identifierHasSpaces ? identifier.removeCharacters (" ") : identifier;
+    }
+
+    // Everything between the brackets, without quotes
+    String getParameter() const                     { return Argument { parameterStart, parameterEnd, parameterHasQuotes ? Argument::quoted : Argument::word }.toString(); }
+
+    int getNumArguments() const                     { return arguments.size(); }
+    const Argument& getArgumentToken (int index) const { return arguments.getReference (index); }
+
+    // Out of range arguments read as empty, as with StringArray
+    String getArgument (int index) const            { return isPositiveAndBelow (index, arguments.size()) ? arguments.getReference (index).toString() : String(); }
+    float getFloatArgument (int index) const        { return isPositiveAndBelow (index, arguments.size()) ? (float) arguments.getReference (index).getDoubleValue() : 0.f; }
+    int getIntArgument (int index) const            { return isPositiveAndBelow (index, arguments.size()) ? arguments.getReference (index).getIntValue() : 0; }
+
+    StringArray getArguments() const
+    {
+        StringArray strTokens;
+        strTokens.ensureStorageAllocated (arguments.size());
+
+        for (const auto& argument : arguments)
+            strTokens.add (argument.toString());
+
+        return strTokens;
+    }
+
+    // Reads the arguments as either a colour name or 3 or 4 integer components
+    Colour getColourArgument() const
+    {
+        if (arguments.size() < 2)
+        {
+            const String name (getArgument (0).trim());
+            return name == "0" ? Colours::white.withAlpha (1.f) : Colours::findColourForName (name, Colours::white);
+        }
+
+        if (arguments.size() == 4)
+            return Colour::fromRGBA ((uint8) getIntArgument (0), (uint8) getIntArgument (1),
+                                     (uint8) getIntArgument (2), (uint8) getIntArgument (3));
+
+        if (arguments.size() == 3)
+            return Colour::fromRGB ((uint8) getIntArgument (0), (uint8) getIntArgument (1), (uint8) getIntArgument (2));
+
+        return Colour();
+    }
+
+private:
+    //==============================================================================
+    bool readGroup (CharPointer groupStart, CharPointer groupEnd)
+    {
+        while (groupStart != groupEnd && (groupStart.isWhitespace() || *groupStart == ','))
+            ++groupStart;
+
+        while (groupEnd != groupStart)
+        {
+            CharPointer previous (groupEnd);
+            --previous;
+
+            if (! previous.isWhitespace())
+                break;
+
+            groupEnd = previous;
+        }
+
+        CharPointer bracket (groupStart);
+
+        while (bracket != groupEnd && *bracket != '(')
+            ++bracket;
+
+        if (bracket == groupStart || bracket == groupEnd)
+            return false;
+
+        identifierStart = groupStart;
+        identifierEnd = bracket;
+        identifierShortEnd = bracket;
+        identifierHasSpaces = false;
+        identifierHash = 0;
+
+        uint64 multiplier = 1;
+        bool truncated = false;
+
+        for (CharPointer p (groupStart); p != bracket; ++p)
+        {
+            const juce_wchar c = *p;
+
+            if (c == ' ')
+            {
+                identifierHasSpaces = true;
+                continue;
+            }
+
+            if (truncated)
+                continue;
+
+            identifierHash += multiplier * (uint64) c;
+            multiplier *= 101;
+
+            if (c == ':')
+            {
+                truncated = true;
+                identifierShortEnd = p + 1;
+            }
+        }
+
+        if (identifierHash == 0)
+            return false;
+
+        parameterStart = bracket + 1;
+        parameterEnd = groupEnd;
+        parameterHasQuotes = false;
+        readArguments();
+        return true;
+    }
+
+    void readArguments()
+    {
+        arguments.clearQuick();
+
+        Argument argument { parameterStart, parameterStart, Argument::word };
+        bool hasText = false, isNumeric = true, hasDigits = false;
+
+        for (CharPointer p (parameterStart);; ++p)
+        {
+            if (p == parameterEnd || *p == ',')
+            {
+                argument.end = p;
+
+                if (argument.type != Argument::quoted)
+                    argument.type = (isNumeric && hasDigits) ? Argument::number : Argument::word;
+
+                //a trailing empty argument is dropped
+                if (p != parameterEnd || hasText)
+                    arguments.add (argument);
+
+                if (p == parameterEnd)
+                    break;
+
+                argument = { p + 1, p + 1, Argument::word };
+                hasText = false;
+                isNumeric = true;
+                hasDigits = false;
+                continue;
+            }
+
+            const juce_wchar c = *p;
+
+            if (c == '"')
+            {
+                argument.type = Argument::quoted;
+                parameterHasQuotes = true;
+                continue;
+            }
+
+            hasText = true;
+
+            if (CharacterFunctions::isDigit (c))
+                hasDigits = true;
+            else if (! (c == ' ' || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E'))
+                isNumeric = false;
+        }
+    }
+
+    //==============================================================================
+    String text;
+    CharPointer position, end;
+
+    CharPointer identifierStart { nullptr }, identifierEnd { nullptr }, identifierShortEnd { nullptr };
+    CharPointer parameterStart { nullptr }, parameterEnd { nullptr };
+    uint64 identifierHash = 0;
+    bool identifierHasSpaces = false, parameterHasQuotes = false;
+    Array<Argument> arguments;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageIdentifierLexer)
+};
+
+#endif  // CABBAGEIDENTIFIERLEXER_H_INCLUDED
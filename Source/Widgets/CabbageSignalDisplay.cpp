@@ -48,6 +48,13 @@ CabbageSignalDisplay::CabbageSignalDisplay (ValueTree wData, CabbagePluginEditor
 {
     setName (CabbageWidgetData::getStringProp (wData, CabbageIdentifierIds::name));
     widgetData.addListener (this);              //add listener to valueTree so it gets notified when a widget's property changes
+
+    for (int i = 0; i < 256; i++)
+    {
+        const float level = i / 255.f;
+        spectrogramColours[i] = Colour::fromHSV (level, 1.0f, level, 1.0f).getPixelARGB();
+    }
+
     initialiseCommonAttributes (this, wData);   //initialise common attributes such as bounds, name, rotation, etc..
 
     addAndMakeVisible (freqRangeDisplay);
@@ -156,6 +163,9 @@ void CabbageSignalDisplay::showScrollbar (bool show)
     }
 }
 
+//====================================================================================
+// Scrolls the spectrogram one pixel to the left and writes the newest frame into
+// the two right hand columns directly, looking its colours up in a table
 //====================================================================================
 void CabbageSignalDisplay::drawSonogram()
 {
@@ -164,68 +174,159 @@ void CabbageSignalDisplay::drawSonogram()
 
     spectrogramImage.moveImageSection (0, 0, 1, 0, rightHandEdge, imageHeight);
 
-    Graphics g (spectrogramImage);
-    Range<float> maxLevel = FloatVectorOperations::findMinAndMax (signalFloatArray.getRawDataPointer(), signalFloatArray.size());
+    const float* const data = signalFloatArray.getRawDataPointer();
+    Range<float> maxLevel = FloatVectorOperations::findMinAndMax (data, signalFloatArray.size());
+    Image::BitmapData pixels (spectrogramImage, rightHandEdge, 0, 2, imageHeight, Image::BitmapData::writeOnly);
 
     for (int y = 0; y < imageHeight; y++)
     {
-        const int index = jmap (y, 0, imageHeight, 0, vectorSize);
-        const float level = jmap (signalFloatArray[index], 0.0f, jmax (maxLevel.getEnd(), signalFloatArray[index] + 0.1f), 0.0f, 1.0f);
-        g.setColour (Colour::fromHSV (level, 1.0f, level, 1.0f));
-        g.drawHorizontalLine (imageHeight - y, rightHandEdge, rightHandEdge + 2);
+        const int index = jmin (jmap (y, 0, imageHeight, 0, vectorSize), signalFloatArray.size() - 1);
+        const float level = jmap (data[index], 0.0f, jmax (maxLevel.getEnd(), data[index] + 0.1f), 0.0f, 1.0f);
+        const PixelARGB& colour = spectrogramColours[jlimit (0, 255, roundToInt (level * 255.f))];
+
+        for (int x = 0; x < 2; x++)
+        {
+            uint8* const pixel = pixels.getPixelPointer (x, imageHeight - 1 - y);
+
+            //native RGB images are stored as ARGB on some platforms
+            if (pixels.pixelFormat == Image::RGB)
+                reinterpret_cast<PixelRGB*> (pixel)->set (colour);
+            else
+                reinterpret_cast<PixelARGB*> (pixel)->set (colour);
+        }
     }
 }
 
+//====================================================================================
+// Returns the range of bins that land on pixel x, when vectorSize bins are spread
+// across numPixels pixels. Always at least one bin wide.
+//====================================================================================
+Range<int> CabbageSignalDisplay::getBinsForPixel (int x, int numPixels) const
+{
+    const int start = int ((int64) x * vectorSize / numPixels);
+    const int end = int ((int64) (x + 1) * vectorSize / numPixels);
+    return Range<int> (start, jmax (start + 1, end));
+}
+
+//====================================================================================
+// When there are more bins than pixels each pixel column shows the loudest of
+// its bins. All the bars are collected and filled in one go.
 //====================================================================================
 void CabbageSignalDisplay::drawSpectroscope (Graphics& g)
 {
-    for (int i = 0; i < vectorSize; i++)
+    const int offset = isScrollbarShowing == true ? scrollbarHeight : 0;
+    const int height = getHeight() - offset;
+    const int numPixels = scopeWidth - leftPos;
+    const float* const data = signalFloatArray.getRawDataPointer();
+    RectangleList<int> bars;
+
+    if (numPixels <= 0 || vectorSize > signalFloatArray.size())
+        return;
+
+    if (vectorSize > numPixels)
+    {
+        const int firstVisible = jmax (0, -leftPos);
+        const int lastVisible = jmin (numPixels, getWidth() - leftPos);
+
+        for (int x = firstVisible; x < lastVisible; x++)
+        {
+            const Range<int> bins = getBinsForPixel (x, numPixels);
+            const float level = FloatVectorOperations::findMaximum (data + bins.getStart(), jmin (bins.getEnd(), vectorSize) - bins.getStart());
+            const int amp = jlimit (0, height, int (level * 3 * height));
+            bars.addWithoutMerging (Rectangle<int> (x + leftPos, height - amp, 1, amp));
+        }
+    }
+    else
     {
-        const int position = jmap (i, 0, vectorSize, leftPos, scopeWidth);
-        const int offset = isScrollbarShowing == true ? scrollbarHeight : 0;
-        const int height = getHeight() - offset;
-        const int amp = (signalFloatArray[i] * 3 * height);
-        g.setColour (colour);
-        g.drawVerticalLine (position, height - amp, height);
+        for (int i = 0; i < vectorSize; i++)
+        {
+            const int position = jmap (i, 0, vectorSize, leftPos, scopeWidth);
+            const int amp = jlimit (0, height, int (data[i] * 3 * height));
+
+            if (position >= 0 && position < getWidth())
+                bars.addWithoutMerging (Rectangle<int> (position, height - amp, 1, amp));
+        }
     }
+
+    g.setColour (colour);
+    g.fillRectList (bars);
 }
 
+//====================================================================================
+// Waveforms are built as a single path. Once there are more than two samples per
+// pixel each column is reduced to its min/max envelope.
 //====================================================================================
 void CabbageSignalDisplay::drawWaveform (Graphics& g)
 {
     const int offset = isScrollbarShowing == true ? scrollbarHeight : 0;
-    const int height = getHeight() - offset;
-    int prevXPos = 0;
-    int prevYPos = jmap (signalFloatArray[0]*-1.f, -1.f, 1.f, 0.f, 1.f) * height;
+    const float height = float (getHeight() - offset);
+    const int numPixels = scopeWidth - leftPos;
+    const float* const data = signalFloatArray.getRawDataPointer();
+    Path waveform;
 
-    for (int i = 0; i < vectorSize; i++)
+    if (numPixels <= 0 || vectorSize <= 0 || vectorSize > signalFloatArray.size())
+        return;
+
+    if (vectorSize > numPixels * 2)
     {
-        const int position = jmap (i, 0, vectorSize, leftPos, scopeWidth);
-        const int amp = jmap (signalFloatArray[i]*-1.f, -1.f, 1.f, 0.f, 1.f) * height;
-        g.setColour (colour);
-        g.drawLine (prevXPos, prevYPos, position, amp, lineThickness);
-        prevXPos = position;
-        prevYPos = amp;
+        const int firstVisible = jmax (0, -leftPos);
+        const int lastVisible = jmin (numPixels, getWidth() - leftPos);
+
+        for (int x = firstVisible; x < lastVisible; x++)
+        {
+            const Range<int> bins = getBinsForPixel (x, numPixels);
+            const Range<float> envelope = FloatVectorOperations::findMinAndMax (data + bins.getStart(), jmin (bins.getEnd(), vectorSize) - bins.getStart());
+            const float xPos = float (x + leftPos);
+            const float top = jmap (envelope.getEnd() * -1.f, -1.f, 1.f, 0.f, 1.f) * height;
+            const float bottom = jmap (envelope.getStart() * -1.f, -1.f, 1.f, 0.f, 1.f) * height;
+
+            if (waveform.isEmpty())
+                waveform.startNewSubPath (xPos, top);
+            else
+                waveform.lineTo (xPos, top);
+
+            waveform.lineTo (xPos, bottom);
+        }
     }
+    else
+    {
+        waveform.startNewSubPath (float (leftPos), jmap (data[0] * -1.f, -1.f, 1.f, 0.f, 1.f) * height);
+
+        for (int i = 1; i < vectorSize; i++)
+        {
+            const float position = jmap (float (i), 0.f, float (vectorSize), float (leftPos), float (scopeWidth));
+            waveform.lineTo (position, jmap (data[i] * -1.f, -1.f, 1.f, 0.f, 1.f) * height);
+        }
+    }
+
+    g.setColour (colour);
+    g.strokePath (waveform, PathStrokeType (float (lineThickness)));
 }
 
 //====================================================================================
 void CabbageSignalDisplay::drawLissajous (Graphics& g)
 {
     const int offset = isScrollbarShowing == true ? scrollbarHeight : 0;
-    const int height = getHeight() - offset;
-    int prevXPos = jmap (signalFloatArray[0], -1.f, 1.f, (float)leftPos, (float)scopeWidth);;
-    int prevYPos = jmap (signalFloatArray2[1], -1.f, 1.f, 0.f, 1.f) * height;
+    const float height = float (getHeight() - offset);
+    const int numPoints = jmin (vectorSize, signalFloatArray.size(), signalFloatArray2.size());
+    Path curve;
+
+    if (numPoints < 2)
+        return;
 
-    for (int i = 0; i < vectorSize; i++)
+    for (int i = 0; i < numPoints; i++)
     {
-        const int position = jmap (signalFloatArray[i], -1.f, 1.f, (float)leftPos, (float)scopeWidth);
-        const int amp = jmap (signalFloatArray2[i], -1.f, 1.f, 0.f, 1.f) * height;
-        g.setColour (colour);
-        g.drawLine (prevXPos, prevYPos, position, amp, lineThickness);
-        prevXPos = position;
-        prevYPos = amp;
+        const float position = jmap (signalFloatArray.getUnchecked (i), -1.f, 1.f, (float)leftPos, (float)scopeWidth);
+        const float amp = jmap (signalFloatArray2.getUnchecked (i), -1.f, 1.f, 0.f, 1.f) * height;
+
+        if (i == 0)
+            curve.startNewSubPath (position, amp);
+        else
+            curve.lineTo (position, amp);
     }
+
+    g.setColour (colour);
+    g.strokePath (curve, PathStrokeType (float (lineThickness)));
 }
 
 //====================================================================================
@@ -264,10 +365,8 @@ void CabbageSignalDisplay::mouseMove (const MouseEvent& e)
 }
 
 //====================================================================================
-void CabbageSignalDisplay::setSignalFloatArray (Array<float, CriticalSection> _points)
+void CabbageSignalDisplay::updateSignalFloatArray()
 {
-    signalFloatArray.swapWith (_points);
-
     if (displayType == "lissajous" || displayType == "waveform")
         vectorSize = signalFloatArray.size() / 2;
     else
@@ -284,10 +383,8 @@ void CabbageSignalDisplay::setSignalFloatArray (Array<float, CriticalSection> _p
 }
 
 //====================================================================================
-void CabbageSignalDisplay::setSignalFloatArraysForLissajous (Array<float, CriticalSection> _points1, Array<float, CriticalSection> _points2)
+void CabbageSignalDisplay::updateSignalFloatArraysForLissajous()
 {
-    signalFloatArray.swapWith (_points1);
-    signalFloatArray2.swapWith (_points2);
     vectorSize = signalFloatArray.size();
 
     if (vectorSize > 0)
@@ -299,26 +396,33 @@ void CabbageSignalDisplay::setSignalFloatArraysForLissajous (Array<float, Critic
 //====================================================================================
 void CabbageSignalDisplay::timerCallback()
 {
-    if (owner->shouldUpdateSignalDisplay())
-    {
-        const String variable = CabbageWidgetData::getStringProp (widgetData, CabbageIdentifierIds::signalvariable);
-        const String displayType = CabbageWidgetData::getStringProp (widgetData, CabbageIdentifierIds::displaytype);
+    //the arrays are only refilled, and the display repainted, when Csound has drawn something new
+    const String variable = CabbageWidgetData::getStringProp (widgetData, CabbageIdentifierIds::signalvariable);
+    const String displayType = CabbageWidgetData::getStringProp (widgetData, CabbageIdentifierIds::displaytype);
 
-        if (displayType != "lissajous")
+    if (displayType != "lissajous")
+    {
+        if (owner->getArrayForSignalDisplay (variable, displayType, signalFloatArray))
         {
-            setSignalFloatArray (owner->getArrayForSignalDisplay (variable, displayType));
+            updateSignalFloatArray();
+            repaint();
         }
-        else
-        {
-            var signalVariables = CabbageWidgetData::getProperty (widgetData, CabbageIdentifierIds::signalvariable);
-
-            if (signalVariables.size() == 2)
-                setSignalFloatArraysForLissajous (owner->getArrayForSignalDisplay (signalVariables[0], displayType),
-                                                  owner->getArrayForSignalDisplay (signalVariables[1], displayType));
+    }
+    else
+    {
+        var signalVariables = CabbageWidgetData::getProperty (widgetData, CabbageIdentifierIds::signalvariable);
 
+        if (signalVariables.size() == 2)
+        {
+            const bool xUpdated = owner->getArrayForSignalDisplay (signalVariables[0], displayType, signalFloatArray);
+            const bool yUpdated = owner->getArrayForSignalDisplay (signalVariables[1], displayType, signalFloatArray2);
+
+            if (xUpdated || yUpdated)
+            {
+                updateSignalFloatArraysForLissajous();
+                repaint();
+            }
         }
-
-        repaint();
     }
 
 }
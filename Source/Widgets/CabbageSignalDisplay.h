@@ -34,8 +34,8 @@ class CabbageSignalDisplay : public Component, public ValueTree::Listener, publi
 
     String name, displayType;
     RoundButton zoomInButton, zoomOutButton;
-    Array<float, CriticalSection> signalFloatArray;
-    Array<float, CriticalSection> signalFloatArray2;
+    Array<float> signalFloatArray;
+    Array<float> signalFloatArray2;
     var signalVariables;
     int tableNumber, freq, shouldDrawSonogram, leftPos, scrollbarHeight,
         minFFTBin, maxFFTBin, vectorSize, zoomLevel, scopeWidth, lineThickness;
@@ -47,6 +47,7 @@ class CabbageSignalDisplay : public Component, public ValueTree::Listener, publi
     int updateRate {100};
 
     Image spectrogramImage, spectroscopeImage;
+    PixelARGB spectrogramColours[256];    //level to colour lookup for the spectrogram
     FrequencyRangeDisplayComponent freqRangeDisplay;
     Range<int> freqRange;
 
@@ -73,9 +74,10 @@ public:
     void drawSpectroscope (Graphics& g);
     void drawWaveform (Graphics& g);
     void drawLissajous (Graphics& g);
+    Range<int> getBinsForPixel (int x, int numPixels) const;
     void paint (Graphics& g) override;
-    void setSignalFloatArray (Array<float, CriticalSection> _points);
-    void setSignalFloatArraysForLissajous (Array<float, CriticalSection> _points1, Array<float, CriticalSection> _points2);
+    void updateSignalFloatArray();
+    void updateSignalFloatArraysForLissajous();
     void resized() override;
     void mouseMove (const MouseEvent& e) override;
     void showPopup (String text);
@@ -20,6 +20,7 @@
 
 
 #include "CabbageWidgetData.h"
+#include "CabbageIdentifierLexer.h"
 #define MAX_MATRIX_SIZE 64
 
 //#include "CabbageWidgetDataInitMethods.cpp"
@@ -31,144 +32,28 @@ constexpr unsigned long long int HashStringToInt (const char* str, unsigned long
     return (*str == 0) ? hash : 101 * HashStringToInt (str + 1) + *str;
 }
 //===============================================================================
-void CabbageWidgetData::setWidgetState (ValueTree widgetData, String lineFromCsd, int ID)
+// Widget type registry. Each type maps to the init function that assigns its
+// default properties. The lookup switches on HashStringToInt, so a hash collision
+// between two registered types fails to compile, and matching a type costs one
+// pass over its name. The defaults for each type are built once into a template
+// tree, which every widget of that type copies its properties from. String values
+// are reference counted and shared with the template. Arrays are not: setProperty()
+// gives each widget its own copy, as widgets and the properties panel edit them in place.
+//===============================================================================
+namespace
 {
-    setProperty (widgetData, "scalex", 1);
-    setProperty (widgetData, "scaley", 1);
-    setProperty (widgetData, "resize", 0);
-    setProperty (widgetData, CabbageIdentifierIds::active, 1);
-    setProperty (widgetData, CabbageIdentifierIds::parentdir, "");
-    setProperty (widgetData, CabbageIdentifierIds::manufacturer, "CabbageAudio");
-    setProperty (widgetData, CabbageIdentifierIds::imgdebug, 0);
-    setProperty (widgetData, CabbageIdentifierIds::allowboundsupdate, 0);
-    setProperty (widgetData, CabbageIdentifierIds::identchannelmessage, "");
-    setProperty (widgetData, CabbageIdentifierIds::popuptext, "");
-    setProperty (widgetData, CabbageIdentifierIds::alpha, 1);
-    setProperty (widgetData, CabbageIdentifierIds::visible, 1);
-    setProperty (widgetData, CabbageIdentifierIds::rotate, 0.f);
-    setProperty (widgetData, CabbageIdentifierIds::pivotx, 0.f);
-    setProperty (widgetData, CabbageIdentifierIds::pivoty, 0.f);
-    setProperty (widgetData, CabbageIdentifierIds::linenumber, ID);
-    setProperty (widgetData, CabbageIdentifierIds::decimalplaces, 0);
-    setProperty (widgetData, CabbageIdentifierIds::update, 0);
-    setProperty (widgetData, CabbageIdentifierIds::arraysize, 0);
-    setProperty (widgetData, CabbageIdentifierIds::plant, "");
-    setProperty (widgetData, CabbageIdentifierIds::basechannel, "");
-    setProperty (widgetData, CabbageIdentifierIds::typeface, "");
-    setProperty (widgetData, CabbageIdentifierIds::surrogatelinenumber, -99);
-
-    StringArray strTokens;
-    strTokens.addTokens (lineFromCsd, " ", "\"");
-
-    if(strTokens.size()>0)
-        setProperty (widgetData, CabbageIdentifierIds::type, strTokens[0].trim());
-
-    setProperty (widgetData, CabbageIdentifierIds::widgetarray, "");
-
-    if (strTokens[0].trim() == String(CabbageWidgetTypes::hslider))
-        setHSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::vslider))
-        setVSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::rslider))
-        setRSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::groupbox))
-        setGroupBoxProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::csoundoutput))
-        setCsoundOutputProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::keyboard) || 
-		strTokens[0].trim() == String(CabbageWidgetTypes::keyboarddisplay))
-        setKeyboardProperties (widgetData, ID, (strTokens[0].trim() == "keyboard" ? false : true));
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::form))
-        setFormProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::textbox))
-        setTextBoxProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::checkbox))
-        setCheckBoxProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::nslider))
-        setNumberSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::combobox))
-        setComboBoxProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::label))
-        setLabelProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::listbox))
-        setListBoxProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::texteditor))
-        setTextEditorProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::image))
-        setImageProperties (widgetData, ID);
+    typedef void (*WidgetInitFunction) (ValueTree, int);
 
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::encoder))
-        setEncoderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::hmeter))
-        setMeterProperties (widgetData, ID, false);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::vmeter))
-        setMeterProperties (widgetData, ID, true);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::button))
-        setButtonProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::soundfiler))
-        setSoundfilerProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::filebutton))
-        setFileButtonProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::infobutton))
-        setInfoButtonProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::line))
-        setLineProperties (widgetData, ID);
-    
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::cvoutput) || strTokens[0].trim() == String(CabbageWidgetTypes::cvinput))
-        setPortProperties (widgetData, ID, strTokens[0].trim());
-    
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::screw))
-        setScrewProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::light))
-        setLightProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::sourcebutton) || strTokens[0].trim() == String(CabbageWidgetTypes::loadbutton))
-        setLoadButtonProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::signaldisplay) || strTokens[0].trim() == String(CabbageWidgetTypes::fftdisplay))
-        setSignalDisplayProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::xypad))
-        setXYPadProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::gentable))
-        setGenTableProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::hrange))
-        setHRangeSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::vrange))
-        setVRangeSliderProperties (widgetData, ID);
-
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::eventsequencer))
-        setEventSequencerProperties (widgetData, ID);
+    struct WidgetTypeEntry
+    {
+        const char* type;
+        WidgetInitFunction init;
+        bool appendsIdToName;
+    };
 
-    //===============table==================//
-    else if (strTokens[0].trim() == String(CabbageWidgetTypes::table))
+    void setTableProperties (ValueTree widgetData, int ID)
     {
-        setProperty (widgetData, "basetype", "layout");
+        CabbageWidgetData::setProperty (widgetData, "basetype", "layout");
         var tableColours;
         tableColours.append ("white");
         tableColours.append ("cornflowerblue");
@@ -177,77 +62,192 @@ void CabbageWidgetData::setWidgetState (ValueTree widgetData, String lineFromCsd
         tableColours.append ("green");
         tableColours.append ("pink");
 
-        setProperty (widgetData, CabbageIdentifierIds::top, 10);
-        setProperty (widgetData, CabbageIdentifierIds::left, 10);
-        setProperty (widgetData, CabbageIdentifierIds::width, 400);
-        setProperty (widgetData, CabbageIdentifierIds::height, 200);
-        setProperty (widgetData, CabbageIdentifierIds::tablenumber, 1);
-        setProperty (widgetData, CabbageIdentifierIds::drawmode, "");
-        setProperty (widgetData, CabbageIdentifierIds::resizemode, 0);
-        setProperty (widgetData, CabbageIdentifierIds::readonly, 0);
-        setProperty (widgetData, CabbageIdentifierIds::tablecolour, tableColours);
-        setProperty (widgetData, CabbageIdentifierIds::amprange, 0);
-        setProperty (widgetData, CabbageIdentifierIds::type, "table");
-        setProperty (widgetData, CabbageIdentifierIds::stack, 0);
-        setProperty (widgetData, CabbageIdentifierIds::name, getProperty (widgetData, "name").toString() + String (ID));
-        setProperty (widgetData, CabbageIdentifierIds::identchannel, "");
-        setProperty (widgetData, CabbageIdentifierIds::visible, 1);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::top, 10);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::left, 10);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::width, 400);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::height, 200);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::tablenumber, 1);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::drawmode, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::resizemode, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::readonly, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::tablecolour, tableColours);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::amprange, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::type, "table");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::stack, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::name, CabbageWidgetData::getProperty (widgetData, "name").toString() + String (ID));
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::identchannel, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::visible, 1);
     }
 
-    //===============stepper example==================//
-    else if (strTokens[0].trim() == "stepper")
+    void setStepperProperties (ValueTree widgetData, int ID)
     {
-        setProperty (widgetData, "basetype", "layout");
-        setProperty (widgetData, CabbageIdentifierIds::top, 10);
-        setProperty (widgetData, CabbageIdentifierIds::left, 10);
-        setProperty (widgetData, CabbageIdentifierIds::width, 160);
-        setProperty (widgetData, CabbageIdentifierIds::height, 2);
-        setProperty (widgetData, CabbageIdentifierIds::colour, Colours::white.toString());
-        setProperty (widgetData, CabbageIdentifierIds::type, "stepper");
-        setProperty (widgetData, CabbageIdentifierIds::name, "stepper");
-        setProperty (widgetData, CabbageIdentifierIds::name, getProperty (widgetData, "name").toString() + String (ID));
-        setProperty (widgetData, CabbageIdentifierIds::identchannel, "");
-        setProperty (widgetData, CabbageIdentifierIds::visible, 1);
+        CabbageWidgetData::setProperty (widgetData, "basetype", "layout");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::top, 10);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::left, 10);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::width, 160);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::height, 2);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::colour, Colours::white.toString());
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::type, "stepper");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::name, "stepper");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::name, CabbageWidgetData::getProperty (widgetData, "name").toString() + String (ID));
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::identchannel, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::visible, 1);
     }
 
-    //===============non-GUI host widgets==================//
-    else if (strTokens[0].trim() == "hostbpm")
+    //non-GUI host widgets
+    template <const char* (*typeName)()>
+    void setHostWidgetProperties (ValueTree widgetData, int)
     {
-        setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
-        setProperty (widgetData, CabbageIdentifierIds::name, "hostbpm");
-        setProperty (widgetData, CabbageIdentifierIds::type, "hostbpm");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::name, typeName());
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::type, typeName());
     }
 
-    else if (strTokens[0].trim() == "hostppqpos")
+    const char* hostBpm()       { return "hostbpm"; }
+    const char* hostPpqPos()    { return "hostppqpos"; }
+    const char* hostPlaying()   { return "hostplaying"; }
+    const char* hostRecording() { return "hostrecording"; }
+    const char* hostTime()      { return "hosttime"; }
+
+    bool findWidgetType (const String& type, WidgetTypeEntry& entry)
     {
-        setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
-        setProperty (widgetData, CabbageIdentifierIds::name, "hostppqpos");
-        setProperty (widgetData, CabbageIdentifierIds::type, "hostppqpos");
+        typedef CabbageWidgetData W;
+
+        switch (HashStringToInt (type.toRawUTF8()))
+        {
+            case HashStringToInt ("hslider"):         entry = { "hslider", W::setHSliderProperties, true }; break;
+            case HashStringToInt ("vslider"):         entry = { "vslider", W::setVSliderProperties, true }; break;
+            case HashStringToInt ("rslider"):         entry = { "rslider", W::setRSliderProperties, true }; break;
+            case HashStringToInt ("groupbox"):        entry = { "groupbox", W::setGroupBoxProperties, true }; break;
+            case HashStringToInt ("csoundoutput"):    entry = { "csoundoutput", W::setCsoundOutputProperties, true }; break;
+            case HashStringToInt ("keyboard"):        entry = { "keyboard", [] (ValueTree w, int ID) { W::setKeyboardProperties (w, ID, false); }, true }; break;
+            case HashStringToInt ("keyboarddisplay"): entry = { "keyboarddisplay", [] (ValueTree w, int ID) { W::setKeyboardProperties (w, ID, true); }, true }; break;
+            case HashStringToInt ("form"):            entry = { "form", W::setFormProperties, false }; break;
+            case HashStringToInt ("textbox"):         entry = { "textbox", W::setTextBoxProperties, true }; break;
+            case HashStringToInt ("checkbox"):        entry = { "checkbox", W::setCheckBoxProperties, true }; break;
+            case HashStringToInt ("nslider"):         entry = { "nslider", W::setNumberSliderProperties, true }; break;
+            case HashStringToInt ("combobox"):        entry = { "combobox", W::setComboBoxProperties, true }; break;
+            case HashStringToInt ("label"):           entry = { "label", W::setLabelProperties, true }; break;
+            case HashStringToInt ("listbox"):         entry = { "listbox", W::setListBoxProperties, true }; break;
+            case HashStringToInt ("texteditor"):      entry = { "texteditor", W::setTextEditorProperties, true }; break;
+            case HashStringToInt ("image"):           entry = { "image", W::setImageProperties, true }; break;
+            case HashStringToInt ("encoder"):         entry = { "encoder", W::setEncoderProperties, true }; break;
+            case HashStringToInt ("hmeter"):          entry = { "hmeter", [] (ValueTree w, int ID) { W::setMeterProperties (w, ID, false); }, true }; break;
+            case HashStringToInt ("vmeter"):          entry = { "vmeter", [] (ValueTree w, int ID) { W::setMeterProperties (w, ID, true); }, true }; break;
+            case HashStringToInt ("button"):          entry = { "button", W::setButtonProperties, true }; break;
+            case HashStringToInt ("soundfiler"):      entry = { "soundfiler", W::setSoundfilerProperties, true }; break;
+            case HashStringToInt ("filebutton"):      entry = { "filebutton", W::setFileButtonProperties, true }; break;
+            case HashStringToInt ("infobutton"):      entry = { "infobutton", W::setInfoButtonProperties, true }; break;
+            case HashStringToInt ("line"):            entry = { "line", W::setLineProperties, true }; break;
+            case HashStringToInt ("cvoutput"):        entry = { "cvoutput", [] (ValueTree w, int ID) { W::setPortProperties (w, ID, "cvoutput"); }, true }; break;
+            case HashStringToInt ("cvinput"):         entry = { "cvinput", [] (ValueTree w, int ID) { W::setPortProperties (w, ID, "cvinput"); }, true }; break;
+            case HashStringToInt ("screw"):           entry = { "screw", W::setScrewProperties, true }; break;
+            case HashStringToInt ("light"):           entry = { "light", W::setLightProperties, true }; break;
+            case HashStringToInt ("sourcebutton"):    entry = { "sourcebutton", W::setLoadButtonProperties, true }; break;
+            case HashStringToInt ("loadbutton"):      entry = { "loadbutton", W::setLoadButtonProperties, true }; break;
+            case HashStringToInt ("signaldisplay"):   entry = { "signaldisplay", W::setSignalDisplayProperties, true }; break;
+            case HashStringToInt ("fftdisplay"):      entry = { "fftdisplay", W::setSignalDisplayProperties, true }; break;
+            case HashStringToInt ("xypad"):           entry = { "xypad", W::setXYPadProperties, true }; break;
+            case HashStringToInt ("gentable"):        entry = { "gentable", W::setGenTableProperties, true }; break;
+            case HashStringToInt ("hrange"):          entry = { "hrange", W::setHRangeSliderProperties, true }; break;
+            case HashStringToInt ("vrange"):          entry = { "vrange", W::setVRangeSliderProperties, true }; break;
+            case HashStringToInt ("eventsequencer"):  entry = { "eventsequencer", W::setEventSequencerProperties, true }; break;
+            case HashStringToInt ("table"):           entry = { "table", setTableProperties, true }; break;
+            case HashStringToInt ("stepper"):         entry = { "stepper", setStepperProperties, true }; break;
+            case HashStringToInt ("hostbpm"):         entry = { "hostbpm", setHostWidgetProperties<hostBpm>, false }; break;
+            case HashStringToInt ("hostppqpos"):      entry = { "hostppqpos", setHostWidgetProperties<hostPpqPos>, false }; break;
+            case HashStringToInt ("hostplaying"):     entry = { "hostplaying", setHostWidgetProperties<hostPlaying>, false }; break;
+            case HashStringToInt ("hostrecording"):   entry = { "hostrecording", setHostWidgetProperties<hostRecording>, false }; break;
+            case HashStringToInt ("hosttime"):        entry = { "hosttime", setHostWidgetProperties<hostTime>, false }; break;
+            default: return false;
+        }
+
+        //the hash only narrows it down, an unknown type could still share a hash with a known one
+        return type == entry.type;
     }
 
-    else if (strTokens[0].trim() == "hostplaying")
+    void setCommonProperties (ValueTree widgetData, int ID)
     {
-        setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
-        setProperty (widgetData, CabbageIdentifierIds::name, "hostplaying");
-        setProperty (widgetData, CabbageIdentifierIds::type, "hostplaying");
+        CabbageWidgetData::setProperty (widgetData, "scalex", 1);
+        CabbageWidgetData::setProperty (widgetData, "scaley", 1);
+        CabbageWidgetData::setProperty (widgetData, "resize", 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::active, 1);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::parentdir, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::manufacturer, "CabbageAudio");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::imgdebug, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::allowboundsupdate, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::identchannelmessage, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::popuptext, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::alpha, 1);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::visible, 1);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::rotate, 0.f);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::pivotx, 0.f);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::pivoty, 0.f);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::linenumber, ID);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::decimalplaces, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::update, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::arraysize, 0);
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::plant, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::basechannel, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::typeface, "");
+        CabbageWidgetData::setProperty (widgetData, CabbageIdentifierIds::surrogatelinenumber, -99);
     }
 
-    else if (strTokens[0].trim() == "hostrecording")
+    //templates are built with ID 0, which the init functions append to the name
+    ValueTree getWidgetTemplate (const WidgetTypeEntry& entry)
     {
-        setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
-        setProperty (widgetData, CabbageIdentifierIds::name, "hostrecording");
-        setProperty (widgetData, CabbageIdentifierIds::type, "hostrecording");
+        static CriticalSection templatesLock;
+        static HashMap<String, ValueTree> templates;
+
+        const ScopedLock sl (templatesLock);
+
+        if (templates.contains (entry.type) == false)
+        {
+            ValueTree widgetTemplate ("WidgetTemplate");
+            setCommonProperties (widgetTemplate, 0);
+            CabbageWidgetData::setProperty (widgetTemplate, CabbageIdentifierIds::type, entry.type);
+            CabbageWidgetData::setProperty (widgetTemplate, CabbageIdentifierIds::widgetarray, "");
+            entry.init (widgetTemplate, 0);
+
+            if (entry.appendsIdToName)
+                widgetTemplate.setProperty (CabbageIdentifierIds::name,
+                                            widgetTemplate.getProperty (CabbageIdentifierIds::name).toString().dropLastCharacters (1), nullptr);
+
+            templates.set (entry.type, widgetTemplate);
+        }
+
+        return templates[entry.type];
     }
+}
 
-    else if (strTokens[0].trim() == "hosttime")
+//===============================================================================
+void CabbageWidgetData::setWidgetState (ValueTree widgetData, String lineFromCsd, int ID)
+{
+    const String firstToken = lineFromCsd.upToFirstOccurrenceOf (" ", false, false);
+    WidgetTypeEntry entry;
+
+    if (findWidgetType (firstToken.trim(), entry))
     {
-        setProperty (widgetData, CabbageIdentifierIds::basetype, "layout");
-        setProperty (widgetData, CabbageIdentifierIds::name, "hosttime");
-        setProperty (widgetData, CabbageIdentifierIds::type, "hosttime");
+        const ValueTree widgetTemplate (getWidgetTemplate (entry));
+
+        //Strings are shared with the template, but setProperty() gives each widget its
+        //own copy of any array, so editing one never reaches the template or other widgets
+        for (int i = 0; i < widgetTemplate.getNumProperties(); i++)
+        {
+            const Identifier name (widgetTemplate.getPropertyName (i));
+            setProperty (widgetData, name, widgetTemplate.getProperty (name));
+        }
+
+        setProperty (widgetData, CabbageIdentifierIds::linenumber, ID);
+
+        if (entry.appendsIdToName)
+            setProperty (widgetData, CabbageIdentifierIds::name, widgetTemplate.getProperty (CabbageIdentifierIds::name).toString() + String (ID));
     }
     else
     {
-        setProperty (widgetData, CabbageIdentifierIds::type, strTokens[0]);
+        setCommonProperties (widgetData, ID);
+        setProperty (widgetData, CabbageIdentifierIds::widgetarray, "");
+        setProperty (widgetData, CabbageIdentifierIds::type, firstToken);
     }
 
     //parse the text now that all default values ahve been assigned
@@ -279,23 +279,17 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
         lineOfText = lineOfText.substring (lineOfText.indexOf (typeOfWidget) + typeOfWidget.length()).trim();
     }
 
-    IdentifiersAndParameters identifierValueSet = getSetofIdentifiersAndParameters (lineOfText);
+    CabbageIdentifierLexer lexer (lineOfText);
 
     CabbageIdentifierStrings identifierArray;
 
 
-    for ( int indx = 0 ; indx < identifierValueSet.identifier.size() ; indx++)
+    while (lexer.next())
     {
-        //CabbageUtilities::debug(identifierValueSet.identifier[indx]);
-        StringArray strTokens;
-        String identifier = identifierValueSet.identifier[indx].trimCharactersAtStart (" ");
-
-        if (identifier.indexOf (":") != -1)
-            identifier = identifier.substring (0, identifier.indexOf (":") + 1);
-
-        strTokens = CabbageUtilities::getTokens (identifierValueSet.parameter[indx], ',');
+        const Identifier identifierId (lexer.getIdentifier());
+        const String& identifier = identifierId.toString();
 
-        switch (HashStringToInt (identifier.toStdString().c_str()))
+        switch (lexer.getIdentifierHash())
         {
             //======== strings ===============================
             case HashStringToInt ("kind"):
@@ -323,42 +317,42 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
             case HashStringToInt ("manufacturer"):
             case HashStringToInt ("logger"):
             case HashStringToInt ("namespace"):
-                setProperty (widgetData, identifier, (identifier.contains("fix") ? strTokens[0] : strTokens[0].trim()));
+                setProperty (widgetData, identifierId, (identifier.contains("fix") ? lexer.getArgument (0) : lexer.getArgument (0).trim()));
                 break;
 
             case HashStringToInt ("channel"):
             case HashStringToInt ("channels"):
-                setChannelArrays (strTokens, widgetData, identifier);
+                setChannelArrays (lexer.getArguments(), widgetData, identifier);
                 break;
 
             case HashStringToInt ("channelarray"):
             case HashStringToInt ("widgetarray"):
-                setChannelArrays (strTokens, widgetData, identifier);
+                setChannelArrays (lexer.getArguments(), widgetData, identifier);
                 break;
 
             case HashStringToInt ("items"):
             case HashStringToInt ("text"):
-                setTextItemArrays (strTokens, widgetData, getStringProp(widgetData, CabbageIdentifierIds::type));
+                setTextItemArrays (lexer.getArguments(), widgetData, getStringProp(widgetData, CabbageIdentifierIds::type));
                 break;
 
             case HashStringToInt ("populate"):
-                setPopulateProps (strTokens, widgetData);
+                setPopulateProps (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("imgfile"):
-                setImageFiles (strTokens, widgetData, getStringProp(widgetData, CabbageIdentifierIds::type));
+                setImageFiles (lexer.getArguments(), widgetData, getStringProp(widgetData, CabbageIdentifierIds::type));
                 break;
 
             case HashStringToInt ("shape"):
-                setShapes (strTokens, widgetData);
+                setShapes (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("import"):
-                addFiles (strTokens, widgetData, "import");
+                addFiles (lexer.getArguments(), widgetData, "import");
                 break;
 
             case HashStringToInt ("bundle"):
-                addFiles (strTokens, widgetData, "bundle");
+                addFiles (lexer.getArguments(), widgetData, "bundle");
                 break;
 
             //=========== floats ===============================
@@ -380,6 +374,8 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
             case HashStringToInt ("alpha"):
             case HashStringToInt ("corners"):
             case HashStringToInt ("guirefresh"):
+            case HashStringToInt ("interpolatetransport"):
+            case HashStringToInt ("renderahead"):
             case HashStringToInt ("textbox"):
             case HashStringToInt ("valuetextbox"):
             case HashStringToInt ("velocity"):
@@ -401,53 +397,53 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
             case HashStringToInt ("markerstart"):
             case HashStringToInt ("markerend"):
                 if (getStringProp (widgetData, CabbageIdentifierIds::channeltype) == "string")
-                    setProperty (widgetData, identifier, strTokens[0].trim());
+                    setProperty (widgetData, identifierId, lexer.getArgument (0).trim());
                 else
-                    setProperty (widgetData, identifier, strTokens[0].trim().getFloatValue());
+                    setProperty (widgetData, identifierId, lexer.getFloatArgument (0));
 
                 break;
 
             case HashStringToInt ("crop"):
-                setProperty (widgetData, CabbageIdentifierIds::cropx, strTokens[0].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::cropy, strTokens[1].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::cropwidth, strTokens[2].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::cropheight, strTokens[3].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::cropx, lexer.getFloatArgument (0));
+                setProperty (widgetData, CabbageIdentifierIds::cropy, lexer.getFloatArgument (1));
+                setProperty (widgetData, CabbageIdentifierIds::cropwidth, lexer.getFloatArgument (2));
+                setProperty (widgetData, CabbageIdentifierIds::cropheight, lexer.getFloatArgument (3));
                 break;
 
             case HashStringToInt ("max"):
                 setProperty (widgetData, CabbageIdentifierIds::maxenabled, 1);
-                setProperty (widgetData, CabbageIdentifierIds::max, strTokens[0].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::max, lexer.getFloatArgument (0));
                 break;
 
             case HashStringToInt ("min"):
                 setProperty (widgetData, CabbageIdentifierIds::minenabled, 1);
-                setProperty (widgetData, CabbageIdentifierIds::min, strTokens[0].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::min, lexer.getFloatArgument (0));
                 break;
 
             case HashStringToInt ("range"):
             case HashStringToInt ("rangex"):
             case HashStringToInt ("rangey"):
-                setRange (strTokens, widgetData, identifier);
+                setRange (lexer.getArguments(), widgetData, identifier);
                 break;
 
             case HashStringToInt ("rotate"):
-                setProperty (widgetData, CabbageIdentifierIds::rotate, strTokens[0].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::pivotx, strTokens[1].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::pivoty, strTokens[2].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::rotate, lexer.getFloatArgument (0));
+                setProperty (widgetData, CabbageIdentifierIds::pivotx, lexer.getFloatArgument (1));
+                setProperty (widgetData, CabbageIdentifierIds::pivoty, lexer.getFloatArgument (2));
                 break;
 
             case HashStringToInt ("amprange"):
-                setAmpRange (strTokens, widgetData);
+                setAmpRange (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("rescale"):
-                setProperty (widgetData, CabbageIdentifierIds::scalex, strTokens[0].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::scaley, strTokens[1].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::scalex, lexer.getFloatArgument (0));
+                setProperty (widgetData, CabbageIdentifierIds::scaley, lexer.getFloatArgument (1));
                 break;
 
             //============= ints ===========================
             case HashStringToInt ("signalvariable"):
-                setProperty (widgetData, CabbageIdentifierIds::signalvariable, getVarArrayFromTokens (strTokens));
+                setProperty (widgetData, CabbageIdentifierIds::signalvariable, getVarArrayFromTokens (lexer.getArguments()));
                 break;
 
             case HashStringToInt ("popup"):
@@ -458,50 +454,50 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
             case HashStringToInt ("cellheight"):
             case HashStringToInt ("resize"):
             case HashStringToInt ("gapmarkers"):
-                setProperty (widgetData, identifier, strTokens[0].trim().getIntValue());
+                setProperty (widgetData, identifierId, lexer.getIntArgument (0));
                 break;
                 break;
 
             case HashStringToInt ("tablenumber"):
             case HashStringToInt ("tablenumbers"):
-                setTableNumberArrays (strTokens, widgetData);
+                setTableNumberArrays (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("size"):
-                if (strTokens.size() >= 2)
+                if (lexer.getNumArguments() >= 2)
                 {
-                    setProperty (widgetData, CabbageIdentifierIds::width, strTokens[0].trim().getFloatValue());
-                    setProperty (widgetData, CabbageIdentifierIds::height, strTokens[1].trim().getFloatValue());
+                    setProperty (widgetData, CabbageIdentifierIds::width, lexer.getFloatArgument (0));
+                    setProperty (widgetData, CabbageIdentifierIds::height, lexer.getFloatArgument (1));
                 }
 
                 break;
 
             case HashStringToInt ("bounds"):
-                setBounds (strTokens, widgetData);
+                setBounds (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("pos"):
-                setProperty (widgetData, CabbageIdentifierIds::left, strTokens[0].trim().getFloatValue());
-                setProperty (widgetData, CabbageIdentifierIds::top, strTokens[1].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::left, lexer.getFloatArgument (0));
+                setProperty (widgetData, CabbageIdentifierIds::top, lexer.getFloatArgument (1));
                 break;
 
             case HashStringToInt ("fontstyle"):
-                setFontStyle (strTokens, widgetData);
+                setFontStyle (lexer.getArguments(), widgetData);
                 break;
 
             case HashStringToInt ("scrubberposition"):
-                setScrubberPosition (strTokens, widgetData);
+                setScrubberPosition (lexer.getArguments(), widgetData);
                 break;
 
 			case HashStringToInt("keypressed"):
-				setKeyboardDisplayNotes(strTokens, widgetData);
+				setKeyboardDisplayNotes(lexer.getArguments(), widgetData);
 				break;
 
             case HashStringToInt ("samplerange"):
-                setProperty (widgetData, CabbageIdentifierIds::startpos, strTokens[0].trim().getFloatValue());
+                setProperty (widgetData, CabbageIdentifierIds::startpos, lexer.getFloatArgument (0));
 
-                if (strTokens.size() > 1)
-                    setProperty (widgetData, CabbageIdentifierIds::endpos, strTokens[1].trim().getFloatValue());
+                if (lexer.getNumArguments() > 1)
+                    setProperty (widgetData, CabbageIdentifierIds::endpos, lexer.getFloatArgument (1));
                 else
                     setProperty (widgetData, CabbageIdentifierIds::endpos, -1);
 
@@ -533,37 +529,37 @@ void CabbageWidgetData::setCustomWidgetState (ValueTree widgetData, String lineO
             case HashStringToInt ("textboxcolour"):
             case HashStringToInt ("textboxoutlinecolour"):
             case HashStringToInt ("markercolour"):
-                setProperty (widgetData, identifier, getColourFromText (strTokens.joinIntoString (",")).toString());
+                setProperty (widgetData, identifierId, lexer.getColourArgument().toString());
                 break;
 
             case HashStringToInt ("colour:"):
             case HashStringToInt ("colour"):
             case HashStringToInt ("fontcolour:"):
             case HashStringToInt ("fontcolour"):
-                setColourByNumber (strTokens, widgetData, identifierValueSet.identifier[indx]);
+                setColourByNumber (lexer.getArguments(), widgetData, lexer.getFullIdentifier());
                 break;
 
             case HashStringToInt ("tablecolour"):
             case HashStringToInt ("tablecolours"):
             case HashStringToInt ("tablecolour:"):
-                setColourArrays (strTokens, widgetData, identifierValueSet.identifier[indx]);
+                setColourArrays (lexer.getArguments(), widgetData, lexer.getFullIdentifier());
                 break;
 
             case HashStringToInt ("metercolour"):
             case HashStringToInt ("metercolour:"):
-                setColourArrays (strTokens, widgetData, identifierValueSet.identifier[indx], false);
+                setColourArrays (lexer.getArguments(), widgetData, lexer.getFullIdentifier(), false);
                 break;
 
             //matrix event props
             case HashStringToInt ("celldata"):
-                setCellData(strTokens, identifierValueSet.parameter[indx], widgetData);
+                setCellData(lexer.getArguments(), lexer.getParameter(), widgetData);
                 break;
 			case HashStringToInt("rowprefix"):
 			case HashStringToInt("colprefix"):
-				setMatrixPrefix(strTokens, identifierValueSet.parameter[indx], widgetData, identifierValueSet.identifier[indx]);
+				setMatrixPrefix(lexer.getArguments(), lexer.getParameter(), widgetData, lexer.getFullIdentifier());
 				break;
             case HashStringToInt( ("matrixsize")):
-                setMatrixSize(strTokens, widgetData);
+                setMatrixSize(lexer.getArguments(), widgetData);
             default:
                 break;
 
@@ -587,38 +583,16 @@ var CabbageWidgetData::getVarArrayFromTokens (StringArray strTokens)
 
 CabbageWidgetData::IdentifiersAndParameters CabbageWidgetData::getSetofIdentifiersAndParameters (String lineOfText)
 {
-    StringArray identifiersInLine = CabbageUtilities::getTokens (lineOfText.substring (0, lineOfText.lastIndexOf (")")+1).trimCharactersAtStart ("), "), ')');
-
-    StringArray parameters;
-
-    for ( int i = 0 ; i < identifiersInLine.size() ; i++)
-        identifiersInLine.set (i, identifiersInLine[i].trim().trimCharactersAtStart (" ,") + ")");
-
-    for ( int i = 0 ; i < identifiersInLine.size() ; i++)
-    {
-        String parameter = identifiersInLine[i];
-        parameter = parameter.substring (parameter.indexOf ("(") + 1, parameter.lastIndexOf (")")).trimCharactersAtStart ("\"").trimCharactersAtEnd ("\"");
-        parameters.add (parameter);
-    }
-
-    for ( int i = 0 ; i < identifiersInLine.size() ; i++)
-    {
-        const String newToken = identifiersInLine[i];
-        identifiersInLine.set (i, newToken.substring (0, newToken.indexOf ("(")));
-    }
-
     IdentifiersAndParameters valueSet;
-    identifiersInLine.removeEmptyStrings();
+    CabbageIdentifierLexer lexer (lineOfText);
 
-    for ( int i = 0 ; i < identifiersInLine.size() ; i++)
+    while (lexer.next())
     {
-        valueSet.identifier.add (identifiersInLine[i].removeCharacters(" "));
-        valueSet.parameter.add (parameters[i].removeCharacters ("\""));
+        valueSet.identifier.add (lexer.getFullIdentifier());
+        valueSet.parameter.add (lexer.getParameter());
     }
 
-
     return valueSet;
-
 }
 
 String CabbageWidgetData::replaceIdentifier (String line, String identifier, String updatedIdentifier)
@@ -1130,28 +1104,32 @@ void CabbageWidgetData::setRange (StringArray strTokens, ValueTree widgetData, S
 
 //=========================================================================
 // retrieve/set widget tree data
+//the getters read the stored var in place rather than copying it out first
 float CabbageWidgetData::getNumProp (ValueTree widgetData, Identifier prop)
 {
-    var props = getProperty (widgetData, prop);
+    const var* props = widgetData.getPropertyPointer (prop);
 
-    if (props.size() > 0)
-        return props[0];
-    else
-        return props;
+    if (props == nullptr)
+        return 0.f;
+
+    if (const Array<var>* array = props->getArray())
+        return array->size() > 0 ? float (array->getReference (0)) : 0.f;
+
+    return *props;
 }
 
 
 String CabbageWidgetData::getStringProp (ValueTree widgetData, Identifier prop)
 {
-    var strings = getProperty (widgetData, prop);
+    const var* strings = widgetData.getPropertyPointer (prop);
 
-    if (strings.size() > 0)
-    {
-        return strings[0].toString ();
-    }
-    else
-        return strings.toString();
+    if (strings == nullptr)
+        return {};
+
+    if (const Array<var>* array = strings->getArray())
+        return array->size() > 0 ? array->getReference (0).toString() : strings->toString();
 
+    return strings->toString();
 }
 
 void CabbageWidgetData::setNumProp (ValueTree widgetData, Identifier prop, float val)
@@ -1166,16 +1144,16 @@ void CabbageWidgetData::setStringProp (ValueTree widgetData, Identifier name, co
 
 void CabbageWidgetData::setProperty (ValueTree widgetData, Identifier name, const var& value)
 {
+    //the tree would ignore an identical value anyway, so don't bother copying it
+    if (const var* existing = widgetData.getPropertyPointer (name))
+        if (existing->equalsWithSameType (value))
+            return;
+
     Array<var>* array = value.getArray();
 
     if (array)
     {
-        var elements;
-
-        for ( int i = 0 ; i < array->size() ; i++)
-            elements.append (array->getReference (i));
-
-        widgetData.setProperty (name, elements, 0);
+        widgetData.setProperty (name, Array<var> (*array), 0);
         return;
     }
 
@@ -0,0 +1,122 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEWIDGETINDEX_H_INCLUDED
+#define CABBAGEWIDGETINDEX_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "CabbageWidgetData.h"
+
+//==============================================================================
+// Hash lookups from widget name and channel to the widget's ValueTree. The
+// index listens to the tree it was attached to and is rebuilt on the next
+// lookup after widgets are added, removed, reordered or have their name or
+// channel changed, so it stays in step with both parsing and the GUI editor.
+// Results match CabbageWidgetData::getValueTreeForComponent(): the first
+// widget with a given name or channel wins, and misses return "empty".
+//==============================================================================
+class CabbageWidgetIndex : private ValueTree::Listener
+{
+public:
+    CabbageWidgetIndex() {}
+    ~CabbageWidgetIndex()
+    {
+        widgets.removeListener (this);
+    }
+
+    void attachTo (ValueTree widgetTree)
+    {
+        widgets.removeListener (this);
+        widgets = widgetTree;
+        widgets.addListener (this);
+        needsRebuild = true;
+    }
+
+    //==============================================================================
+    ValueTree getWidgetForName (const String& name)
+    {
+        if (name == "form")
+            return widgets.getNumChildren() > 0 ? widgets.getChild (0) : ValueTree ("empty");
+
+        const SpinLock::ScopedLockType sl (lock);
+        rebuildIfNeeded();
+        return byName.contains (name) ? byName[name] : ValueTree ("empty");
+    }
+
+    ValueTree getWidgetForChannel (const String& channel)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        rebuildIfNeeded();
+        return byChannel.contains (channel) ? byChannel[channel] : ValueTree ("empty");
+    }
+
+private:
+    void rebuildIfNeeded()
+    {
+        if (needsRebuild == false)
+            return;
+
+        byName.clear();
+        byChannel.clear();
+
+        for (int i = 0; i < widgets.getNumChildren(); i++)
+        {
+            const ValueTree widget = widgets.getChild (i);
+            const String name = widget.getProperty (CabbageIdentifierIds::name).toString();
+            const var channels = widget.getProperty (CabbageIdentifierIds::channel);
+
+            if (name.isNotEmpty() && byName.contains (name) == false)
+                byName.set (name, widget);
+
+            //only the first channel of multichannel widgets is indexed, as with getValueTreeForComponent()
+            const String channel = channels.size() > 0 ? channels[0].toString() : channels.toString();
+
+            if (channel.isNotEmpty() && byChannel.contains (channel) == false)
+                byChannel.set (channel, widget);
+        }
+
+        needsRebuild = false;
+    }
+
+    void invalidate()
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        needsRebuild = true;
+    }
+
+    void valueTreePropertyChanged (ValueTree&, const Identifier& prop) override
+    {
+        if (prop == CabbageIdentifierIds::name || prop == CabbageIdentifierIds::channel)
+            invalidate();
+    }
+
+    void valueTreeChildAdded (ValueTree&, ValueTree&) override                  { invalidate(); }
+    void valueTreeChildRemoved (ValueTree&, ValueTree&, int) override           { invalidate(); }
+    void valueTreeChildOrderChanged (ValueTree&, int, int) override             { invalidate(); }
+    void valueTreeParentChanged (ValueTree&) override                           {}
+
+    ValueTree widgets;
+    HashMap<String, ValueTree> byName, byChannel;
+    SpinLock lock;
+    bool needsRebuild = true;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageWidgetIndex)
+};
+
+#endif  // CABBAGEWIDGETINDEX_H_INCLUDED
@@ -0,0 +1,177 @@
+/*
+  Copyright (C) 2019 Rory Walsh
+
+  Cabbage is free software; you can redistribute it
+  and/or modify it under the terms of the GNU General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  Cabbage is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Csound; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+  02111-1307 USA
+*/
+
+#ifndef CABBAGEWIDGETVALUES_H_INCLUDED
+#define CABBAGEWIDGETVALUES_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "CabbageWidgetData.h"
+
+//==============================================================================
+// Flat, typed store for the numeric widget properties that Csound channels are
+// polled into. Each slot pairs one widget property with one interned channel
+// name. Values live in a plain array and a bit is set for every slot whose
+// value changes, so the polling path is array indexing and compares. The
+// ValueTree stays the copy that editing and saving work from; flushToValueTrees()
+// writes only the changed slots back to it, and the store listens to the tree it
+// is attached to so that edits made there, from the editor or the host, are
+// what the next Csound value is compared against.
+//==============================================================================
+class CabbageWidgetValues  : private ValueTree::Listener
+{
+public:
+    CabbageWidgetValues() {}
+    ~CabbageWidgetValues()
+    {
+        widgetTree.removeListener (this);
+    }
+
+    void attachTo (ValueTree tree)
+    {
+        widgetTree.removeListener (this);
+        widgetTree = tree;
+        widgetTree.addListener (this);
+    }
+
+    //==============================================================================
+    int add (ValueTree widget, const Identifier& property, const Identifier& channel)
+    {
+        const ScopedLock sl (lock);
+        const int slot = widgets.size();
+        widgets.add (widget);
+        properties.add (property);
+        channels.add (channel);
+        values.add (CabbageWidgetData::getNumProp (widget, property));
+
+        if (dirtyBits.size() * 64 < values.size())
+            dirtyBits.add (0);
+
+        return slot;
+    }
+
+    void clear()
+    {
+        const ScopedLock sl (lock);
+        widgets.clear();
+        properties.clear();
+        channels.clear();
+        values.clear();
+        dirtyBits.clear();
+    }
+
+    int size() const noexcept                                   { return values.size(); }
+
+    //==============================================================================
+    // Stores a new value and flags the slot if it differs from the tree's, NaNs are ignored
+    void set (int slot, double newValue)
+    {
+        const ScopedLock sl (lock);
+        double& value = values.getReference (slot);
+
+        if (newValue != value && std::isnan (newValue) == false)
+        {
+            value = newValue;
+            dirtyBits.getReference (slot >> 6) |= (uint64 (1) << (slot & 63));
+        }
+    }
+
+    // Copies the current tree value into a slot without flagging it
+    void read (int slot)
+    {
+        const ScopedLock sl (lock);
+        values.getReference (slot) = CabbageWidgetData::getNumProp (widgets.getReference (slot), properties.getReference (slot));
+    }
+
+    StringArray getChannelNames() const
+    {
+        StringArray names;
+        names.ensureStorageAllocated (channels.size());
+
+        for (const auto& channel : channels)
+            names.add (channel.toString());
+
+        return names;
+    }
+
+    //==============================================================================
+    void flushToValueTrees()
+    {
+        const ScopedLock sl (lock);
+        const ScopedValueSetter<bool> flushingSetter (flushing, true);
+
+        for (int word = 0; word < dirtyBits.size(); word++)
+        {
+            uint64 bits = dirtyBits.getUnchecked (word);
+            dirtyBits.setUnchecked (word, 0);
+
+            while (bits != 0)
+            {
+                const int slot = (word << 6) + countTrailingZeros (bits);
+                bits &= bits - 1;
+
+                CabbageWidgetData::setNumProp (widgets.getReference (slot), properties.getReference (slot), float (values.getUnchecked (slot)));
+            }
+        }
+    }
+
+private:
+    //the tree changed under a slot, through anything but flushToValueTrees()
+    void valueTreePropertyChanged (ValueTree& widget, const Identifier& property) override
+    {
+        const ScopedLock sl (lock);
+
+        if (flushing)
+            return;
+
+        for (int slot = 0; slot < widgets.size(); slot++)
+            if (properties.getReference (slot) == property && widgets.getReference (slot) == widget)
+                read (slot);
+    }
+
+    void valueTreeChildAdded (ValueTree&, ValueTree&) override                  {}
+    void valueTreeChildRemoved (ValueTree&, ValueTree&, int) override           {}
+    void valueTreeChildOrderChanged (ValueTree&, int, int) override             {}
+    void valueTreeParentChanged (ValueTree&) override                           {}
+
+    static int countTrailingZeros (uint64 bits) noexcept
+    {
+        int count = 0;
+
+        while ((bits & 1) == 0)
+        {
+            bits >>= 1;
+            ++count;
+        }
+
+        return count;
+    }
+
+    Array<ValueTree> widgets;
+    Array<Identifier> properties, channels;
+    Array<double> values;
+    Array<uint64> dirtyBits;
+    ValueTree widgetTree;
+    //re-entered by the listener while flushing, and taken by the editor's tree edits
+    CriticalSection lock;
+    bool flushing = false;
+
+    JUCE_DECLARE_NON_COPYABLE (CabbageWidgetValues)
+};
+
+#endif  // CABBAGEWIDGETVALUES_H_INCLUDED